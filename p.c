@@ -1,7 +1,20 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
 #include <time.h>
 #include <curses.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 
 // asset dimensions
 #define SCREEN_R 50
@@ -40,11 +53,76 @@
 #define WEED2_C 18
 #define WEED3_C 24
 #define STARFISH_C 28
+#define SEABED_Y 31
+#define FLOOR_Y 38
+#define SEABED_C 256
+
+// bytes of art loaded at startup, plus room for rounding each of the 24 pieces up to the arena alignment
+#define ART_BYTES (LOADING_R * (LOADING1_C + LOADING2_C + LOADING3_C) + SCREEN_R * SCREEN_C \
+                   + PWON_R * (P1WON_C + P2WON_C) + BOTHWON_R * BOTHWON_C + GAMEOVER_R * GAMEOVER_C \
+                   + FISH_R * FISH_C + SHARK_R * SHARK_C + CAN_R * CAN_C + BAG_R * BAG_C + BOTTLE_R * BOTTLE_C \
+                   + GUEST_R * (WHALE_C + DOLPHIN_C + TURTLE_C) \
+                   + SCENERY_R * (CORAL_C + REEF_C + BUSH_C + ROCK_C + WEED1_C + WEED2_C + WEED3_C + STARFISH_C) \
+                   + 24 * ARENA_ALIGN)
+#define ARENA_ALIGN 16
 
 // game constraints
 #define TRASH_LIMIT 10
 #define SCENERY_LIMIT 10
 #define MAX_SCORE 10
+#define MAX_PLAYERS 8
+#define GARBAGE_PATCH_LIMIT 1024
+#define GARBAGE_PATCH_SCORE 500
+#define ENTITY_LIMIT GARBAGE_PATCH_LIMIT
+
+// autopilot search limits
+#define AUTOPILOT_MAX_DEPTH 16
+#define AUTOPILOT_BUDGET_NS 2000000
+#define BITBOARD_WORDS 5
+#define DEMO_TICK_MS 60
+
+// intro timing (the loading animation runs until the assets are in and at least the minimum time has passed)
+#define LOADING_FRAME_MS 250
+#define MIN_INTRO_MS 500
+
+// session log and index files
+#define SESSION_LOG "assets/sessions.log"
+#define SESSION_INDEX "assets/sessions.idx"
+#define INDEX_MAGIC 0x57534958
+#define LEADERBOARD_SIZE 10
+
+// ansi backend output (worst case is every cell with a color switch, plus a cursor move per row)
+#define ANSI_COLOR_SIZE 8
+#define ANSI_BUFFER_SIZE (SCREEN_R * (SCREEN_C * (ANSI_COLOR_SIZE + 1) + 16) + 32)
+#define ANSI_MERGE_GAP 4
+
+// gameplay recording (frames waiting for the writer thread, and the writer's batch size)
+#define RECORD_QUEUE_SIZE 64
+#define RECORD_BATCH_SIZE (1 << 19)
+#define RECORD_IDLE_MS 5
+
+// frame skipping (terminal backlog and present time that count as congested, how far it backs off, and how long a skipped frame waits for a newer one)
+#define OUTPUT_HIGH_WATER 4096
+#define PRESENT_SLOW_MS 15
+#define MAX_SKIP_LEVEL 4
+#define RECOVER_PRESENTS 30
+#define CATCH_UP_MS 50
+
+// key to screen latency histogram (bucket width, and bucket count where the last one holds anything slower)
+#define LATENCY_BUCKET_US 100
+#define LATENCY_BUCKETS 1000
+
+// practice mode rewind (default and smallest history budget, ticks between full keyframes, 1/n of the budget kept for entries, and ticks per press of Z)
+#define REWIND_BUDGET_KB 64
+#define MIN_REWIND_KB 16
+#define KEYFRAME_INTERVAL 128
+#define REWIND_ENTRY_SHARE 8
+#define REWIND_STEP 16
+#define MIN_RUN 4
+
+// gameplay events (most a tick can emit, and most listeners that can consume them)
+#define EVENT_LIMIT 256
+#define LISTENER_LIMIT 8
 
 // enumerates the the type of game objects
 typedef enum {
@@ -59,113 +137,591 @@ typedef struct {
         Type type;
 } Object;
 
+// colors a cell can be drawn in (each is a curses color pair, and everything but plain is on the water)
+typedef enum {
+        PLAIN, WATER, RED, GREEN, YELLOW, MAGENTA, CYAN, BLACK, PALETTE_SIZE
+} Color;
+
+// what the simulation reports happening during a tick
+typedef enum {
+        TRASH_EVADED, // value is how many pieces the player got past the shark
+        COLLISION, // value is the other player
+        DAZED, // value is the other player, or -1 for trash
+        EATEN,
+        GUEST_SIGHTED, // value is the guest's type
+        GAME_OVER, // value is the result (0 if everyone was eaten, the winner, or -1 if several won)
+        EVENT_TYPES
+} EventType;
+
+typedef struct {
+        EventType type;
+        int player; // -1 for events that are not about one player
+        int value;
+} GameEvent;
+
+// consumes a tick's events (scoring, telemetry, persistence, and the result screens are listeners)
+typedef void (*EventListener)(const GameEvent *events, int count);
+
+// objects of one kind stored as parallel arrays so culling and drawing walk them in tight loops
+typedef struct {
+        int x[ENTITY_LIMIT];
+        int y[ENTITY_LIMIT];
+        int width[ENTITY_LIMIT];
+        Type type[ENTITY_LIMIT];
+        int count;
+} EntityStore;
+
 // game assets (2d but stored in 1d character arrays)
-char *fish1, *fish2, *shark, *can, *bag, *bottle, *whale, *dolphin;
+char *fish, *shark, *can, *bag, *bottle, *whale, *dolphin;
 char *turtle, *coral, *reef, *bush, *rock, *weed1, *weed2, *weed3, *starfish;
 char *starfish, *homePage, *loading1, *loading2, *loading3, *p1Won, *p2Won;
 char *bothWon, *gameOver;
 
-// players start in the middle of screen height and left third of screen width
-Object p1 = {40, 16, FISH};
-Object p2 = {50, 25, FISH}; 
+// art dimensions and assets looked up by object type (instead of branching on it)
+const int typeRows[] = {
+        FISH_R, SHARK_R, CAN_R, BAG_R, BOTTLE_R, GUEST_R, GUEST_R, GUEST_R, SCENERY_R, SCENERY_R,
+        SCENERY_R, SCENERY_R, SCENERY_R, SCENERY_R, SCENERY_R, SCENERY_R
+};
+const int typeColumns[] = {
+        FISH_C, SHARK_C, CAN_C, BAG_C, BOTTLE_C, TURTLE_C, DOLPHIN_C, WHALE_C, CORAL_C, REEF_C,
+        BUSH_C, ROCK_C, WEED1_C, WEED2_C, WEED3_C, STARFISH_C
+};
+char **typeArt[] = {
+        &fish, &shark, &can, &bag, &bottle, &turtle, &dolphin, &whale, &coral, &reef,
+        &bush, &rock, &weed1, &weed2, &weed3, &starfish
+};
+uint8_t typeColors[TRASH]; // read from assets/colors.txt along with the art
+
+// names used by the colors file for each sprite (its art file without .txt) and each color
+const char *typeNames[] = {
+        "fish", "shark", "can", "bag", "bottle", "turtle", "dolphin", "whale", "coral", "reef",
+        "bush", "rock", "weed1", "weed2", "weed3", "starfish"
+};
+const char *colorNames[] = {"plain", "water", "red", "green", "yellow", "magenta", "cyan", "black"};
+
+// foreground of each color (curses and ansi escape sequences number colors the same way)
+const short colorForeground[] = {-1, COLOR_WHITE, COLOR_RED, COLOR_GREEN, COLOR_YELLOW, COLOR_MAGENTA, COLOR_CYAN, COLOR_BLACK};
+#define WATER_BACKGROUND COLOR_BLUE
+
+// players start spread over the middle of screen height and left third of screen width
+const int startX[MAX_PLAYERS] = {40, 50, 60, 70, 45, 55, 65, 75};
+const int startY[MAX_PLAYERS] = {16, 25, 19, 28, 13, 22, 31, 17};
+int numOfPlayers = 2;
+Object players[MAX_PLAYERS];
+char fishEyes[MAX_PLAYERS]; // 'o' normally, '@' while dazed, and 'X' once eaten
+const uint8_t playerColors[MAX_PLAYERS] = {YELLOW, MAGENTA, CYAN, RED, GREEN, WATER, BLACK, YELLOW};
+
+// movement of each action (none, up, down, left, right)
+const int actionX[] = {0, 0, 0, -1, 1};
+const int actionY[] = {0, -1, 1, 0, 0};
+
+// keys each player swims with (up, down, left, right), players without keys are bots
+char keymaps[MAX_PLAYERS][4] = {"wsad", "ikjl", "tgfh", "8546"};
+_Bool isBot[MAX_PLAYERS];
+
+/* fish positions hashed by row: bit i of a row is set while player i's fish is on it,
+   so a fish only has to be checked against the fish sharing its row */
+uint8_t rowPlayers[SCREEN_R-3];
 
 // 47 lines of gameplay + 150 char per line (without 3 line header)
-char scene[SCREEN_R-3][SCREEN_C];
+char sceneBuffer[SCREEN_R-3][SCREEN_C];
+char (*scene)[SCREEN_C] = sceneBuffer; // training environments point this into their observation
+uint8_t sceneColors[SCREEN_R-3][SCREEN_C]; // the color of each scene cell (spaces are always water)
+
+// 3 line header (two dashed lines around the scores and encyclopedia info)
+char header[3][SCREEN_C];
+
+// a whole frame (header and scene) as characters and the color of each one
+typedef struct {
+        char cells[SCREEN_R][SCREEN_C];
+        uint8_t colors[SCREEN_R][SCREEN_C];
+} Screen;
+
+// scenes are drawn in color when the terminal has them (--mono turns them off)
+_Bool monochrome, colored;
+_Bool backColorErase; // the terminal fills deleted cells with the current color, not the plain one
+
+/* when set, gameplay frames skip curses and are written as escape sequences: only spans
+   that differ from what is already on the terminal are sent, with one write() per frame */
+_Bool ansiBackend;
+Screen terminalScreen;
+char ansiOutput[ANSI_BUFFER_SIZE];
+
+// one recorded frame: the escape sequences that turn the previous recorded frame into this one
+typedef struct {
+        double time;
+        int length;
+        char data[ANSI_BUFFER_SIZE];
+} RecordedFrame;
+
+/* Recording to an asciicast file. The game thread composes each frame straight into a slot
+   of a single producer, single consumer ring and the writer thread drains it, so neither ever
+   waits on the other. When the ring is full the frame is dropped and the next one is recorded
+   in full (so playback recovers), rather than blocking the game on the disk. */
+RecordedFrame recordQueue[RECORD_QUEUE_SIZE];
+atomic_uint recordHead, recordTail; // head is only moved by the game, tail only by the writer
+atomic_bool recording;
+Screen recordScreen; // what a player of the recording is showing
+char recordBatch[RECORD_BATCH_SIZE];
+struct timespec recordStart;
+long recordedFrames, droppedFrames;
+atomic_int recordError; // set by the writer (to errno) if the file or gzip stops taking data, which ends the recording
+_Bool lastFrameDropped; // the closing frame is recorded again so the file ends on what was shown
+int recordFile = -1;
+pid_t recordCompressor = -1;
+pthread_t recordThread;
+
+// the frame as the game last drew it, and the copy being presented
+Screen frameScreen, presentScreen;
+
+/* Presenting runs on its own thread so a slow terminal never holds up the game. A frame
+   is skipped while the previous one is still being written, and when the terminal is
+   congested (presents are slow or its output queue backs up) only one frame in
+   2^skipLevel is handed over at all. Both backends diff against what the terminal last
+   showed, so a presented frame carries every change from the frames skipped before it.
+   A skipped frame is not lost: it is kept as the latest frame, which the presenter shows
+   as soon as it finishes a frame, or after CATCH_UP_MS when it was idle and no newer
+   frame came (the game only moves on a key, so nothing else would ever show it). */
+pthread_t presentThread;
+pthread_mutex_t presentLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t presentChanged = PTHREAD_COND_INITIALIZER; // signalled when a frame is handed over or finished
+atomic_bool framePending;
+_Bool presenting;
+atomic_int skipLevel;
+int calmPresents; // presents in a row without congestion (enough of them lower the skip level)
+unsigned long frameNumber;
+long skippedFrames;
+Screen latestScreen; // the newest skipped frame (guarded by presentLock, like the fields below)
+_Bool latestPending;
+
+/* Key to screen latency. The time a key is read travels with the first frame presented
+   after it, whether that frame was handed over or caught up from a skipped one, and the
+   delay is filed once that frame has been written to the terminal. */
+struct timespec keyTime, presentKeyTime, latestKeyTime;
+_Bool keyWaiting, presentHasKey, latestHasKey;
+long latencyCounts[LATENCY_BUCKETS];
+long latencySamples, maxLatencyUs;
+long presentedFrames;
+struct timespec firstPresent, lastPresent;
+int latencyLimitMs; // a run whose 99th percentile is slower than this exits with an error
 
 // keeps track of scene view 
 int sceneX;
 
+// state of the random number generator (kept explicitly so games can be replayed from a seed)
+unsigned int randomState;
+
 // total amount of trash dodged (score)
-int p1TrashEvaded, p2TrashEvaded;
+int trashEvaded[MAX_PLAYERS];
 
 // true while players have not been eaten
-_Bool p1IsAlive, p2IsAlive;
+_Bool isAlive[MAX_PLAYERS];
 
 // trackers for players' dazed status and when to end it
-_Bool p1IsDazed, p2IsDazed;
-int p1DazedCount, p2DazedCount;
+_Bool isDazed[MAX_PLAYERS];
+int dazedCount[MAX_PLAYERS];
 
-// player records
-int p1Highest, p2Highest, encyclopediaLVL;
+// player records (only the first two players' bests are saved)
+int highest[MAX_PLAYERS], encyclopediaLVL;
 _Bool encyclopediaLeveledUp;
 
+// one finished game in the session log (appended in time order, never rewritten)
+typedef struct {
+        int64_t timestamp;
+        int32_t p1Score, p2Score; // p2Score is -1 when player two was the autopilot
+        int32_t guest;
+        int32_t ticks;
+} SessionRecord;
+
+// start of the session index, which also holds the player records
+typedef struct {
+        uint32_t magic;
+        uint32_t count;
+        int32_t p1Highest, p2Highest, encyclopediaLVL;
+} IndexHeader;
+
+// index entries follow the header, sorted by the session's best score (highest first)
+typedef struct {
+        int32_t score;
+        uint32_t session;
+} IndexEntry;
+
+// memory mapped session log and index
+int sessionLogFile = -1, sessionIndexFile = -1;
+SessionRecord *sessionLog;
+IndexHeader *sessionIndex;
+size_t sessionLogSize, sessionIndexSize;
+
 // indicates whether the game is running
 _Bool running = 0;
 
+/* Everything the game allocates at run time (the art and the rewind history) comes out of
+   one arena mapped at startup, sized for all of it, and is only released at exit. The frame
+   buffers and queues are fixed size globals, so a game in progress never touches the heap. */
+char *arena;
+size_t arenaSize, arenaUsed;
+
+#ifdef COUNT_ALLOCATIONS
+/* Debug builds (cc -DCOUNT_ALLOCATIONS) count every heap call made while a game is in its
+   steady state, including calls made by curses and the C library on any thread */
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void __libc_free(void *pointer);
+atomic_bool countingHeap;
+atomic_long heapCalls;
+#endif
+
+// the game assets are loaded on a background thread while the intro plays
+atomic_bool assetsLoaded;
+char *failedAsset; // set to the file name of an asset that could not be read
+_Bool fastStart; // skips the window calibration wait
+
+// practice games can be rewound (and are kept out of the session log)
+_Bool practice;
+
+/* Events emitted during the current tick. The simulation only emits them, and at the end
+   of the tick they are handed to every listener as one batch, so scores, records, and
+   screens change in one place and new listeners need no changes to the simulation. */
+GameEvent events[EVENT_LIMIT];
+int numOfEvents;
+long droppedEvents; // events past the limit in a single tick (never expected)
+EventListener listeners[LISTENER_LIMIT];
+int numOfListeners;
+long eventTotals[EVENT_TYPES]; // telemetry counts of every event seen
+
+// players driven by the computer (bots, everyone but player one for single player, everyone for the demo)
+_Bool isAutopilot[MAX_PLAYERS];
+
+// time the autopilot may spend choosing each move (--autopilot-us), how far it may look ahead, and how far its last search got
+long autopilotBudget = AUTOPILOT_BUDGET_NS;
+int autopilotMaxDepth = AUTOPILOT_MAX_DEPTH;
+int autopilotDepthReached;
+
 // trash & scenery will be created when needed and removed when off screen
-int numOfTrash, numOfScenery;
-Object trash[TRASH_LIMIT], scenery[SCENERY_LIMIT];
+EntityStore trash, scenery;
+
+// garbage patch mode keeps hundreds of trash objects alive at once
+_Bool garbagePatch;
+int trashLimit, scoreLimit;
 
 // only one endangered species shows up per game (encourages replaying)
 Object guest; 
 
+/* the seabed (rows 31 to 46) is pre-rendered into a circular buffer of world columns
+   (column x lives at x % SEABED_C) so each frame only copies a window out of it */
+char seabed[SCENERY_R][SEABED_C];
+uint8_t seabedColors[SCENERY_R][SEABED_C];
+int seabedEnd; // first world column that has not been rendered yet
+
+// everything a game in progress changes (so several games can take turns using the globals)
+typedef struct {
+        int numOfPlayers;
+        Object players[MAX_PLAYERS], guest;
+        int sceneX, seabedEnd;
+        unsigned int randomState;
+        int trashEvaded[MAX_PLAYERS];
+        _Bool isAlive[MAX_PLAYERS], isDazed[MAX_PLAYERS];
+        int dazedCount[MAX_PLAYERS];
+        char fishEyes[MAX_PLAYERS];
+        int highest[MAX_PLAYERS], encyclopediaLVL;
+        _Bool encyclopediaLeveledUp, garbagePatch;
+        int trashLimit, scoreLimit;
+        EntityStore trash, scenery;
+        char seabed[SCENERY_R][SEABED_C];
+        uint8_t seabedColors[SCENERY_R][SEABED_C];
+} GameState;
+
+/* what a training environment sees after each step: the scene is drawn straight into it
+   and the whole array lives in one shared memory mapping, so nothing is copied out */
+typedef struct {
+        char scene[SCREEN_R-3][SCREEN_C];
+        int p1TrashEvaded, p2TrashEvaded, p1Highest, p2Highest, encyclopediaLVL;
+        int p1Reward, p2Reward;
+        _Bool p1IsAlive, p2IsAlive, done;
+} Observation;
+
+// training environments (one saved game state and one observation per environment)
+int numOfEnvs;
+GameState *envStates;
+Observation *observations;
+size_t observationsSize;
+
+// one stored tick of the rewind history (its bytes are runs, see encodeRuns())
+typedef struct {
+        int offset, length;
+        _Bool keyframe; // a keyframe holds the whole state, anything else is xored with the tick before
+} Snapshot;
+
+/* Rewind history for practice games. Snapshots are kept oldest first in a ring of entries
+   whose bytes go into a fixed size byte ring, so the history never outgrows its budget:
+   the oldest ticks are dropped to make room (along with any deltas left without their
+   keyframe). Entries and bytes share the budget, which is all the history ever uses.
+   Most of a game state is the same from one tick to the next, so xoring it with the
+   previous tick leaves long runs of zeros that take a few bytes each. */
+size_t rewindBudget = REWIND_BUDGET_KB * 1024;
+uint8_t *rewindBytes;
+size_t rewindRing; // the part of the budget left for the byte ring
+size_t rewindHead; // where the next snapshot's bytes go
+Snapshot *snapshots;
+int snapshotLimit, firstSnapshot, snapshotCount;
+int sinceKeyframe; // deltas stored since the last keyframe
+GameState rewindLatest, rewindCurrent; // the newest stored state and the one being stored or rebuilt
+uint8_t rewindEncoded[2 * sizeof(GameState)];
+
+/* trash occupancy as compact bit rows for the autopilot: bit i of a row is set if
+   a visible (non space) trash character covers world column sceneX + i */
+uint64_t trashRows[SCREEN_R-3][BITBOARD_WORDS];
+
+// what the autopilot tracks about a fish while looking ahead
+typedef struct {
+        int x, y, dazedCount;
+        _Bool isDazed, isAlive;
+} FishState;
+
+// when the current autopilot search has to stop
+struct timespec autopilotDeadline;
+_Bool autopilotOutOfTime;
+long autopilotNodes;
+
+char* readArt(int rows, int cols, char *fileName); // stores specified ascii art asset in the program's memory without touching the window
 char* loadArt(int rows, int cols, char *fileName); // stores specified ascii art asset in the program's memory
+void readColors(char *fileName); // reads the color each sprite is drawn in without touching the window
+void checkAssets(void); // shows an error and exits if any asset failed to load
+void loadLoadingAssets(void); // loads the loading screen art needed by the intro
+void* loadGameAssets(void *unused); // loads the rest of the ascii art (runs on the loader thread)
 void loadAssets(void); // loads all the ascii art into the game by using loadArt()
-void freeLoadingAssets(void); // frees the loading screen assets
-void freeAssets(void); // frees all the remaining dyncamically allocated asset
+_Bool createArena(size_t size); // maps the arena all run time memory comes from
+void* arenaAlloc(size_t size); // hands out aligned arena memory (NULL once the arena is used up)
+void freeArena(void); // releases the arena and everything in it
+void countHeap(_Bool on); // starts or stops counting heap calls (only in COUNT_ALLOCATIONS builds)
+void warmCurses(void); // formats every parameterized capability curses may use during a game
+void startColors(void); // sets up a color pair for every color (unless the terminal has none)
 void loadInfo(void); // loads all recorded player information
+IndexEntry* indexEntries(void); // the sorted entries following the index header
+_Bool mapSessions(void); // (re)maps the session log and index after they change size (closing them if that fails)
+int compareEntries(const void *a, const void *b); // orders index entries by score (highest first), then by age
+void rebuildIndex(void); // sorts every logged session into a new index
+_Bool openSessions(void); // opens the session log and index, creating or repairing the index if needed
+void recordSession(void); // appends the finished game to the log and inserts it into the index
+void saveRecords(void); // stores the player bests and encyclopedia level in the index header
+int topSessions(SessionRecord *out, int k); // copies the k best sessions (fewer if there are not that many)
+int dayBest(time_t day); // best score of the local day containing the given time (-1 if nobody played)
+int scorePercentile(int percent); // score that the given percent of sessions are at or below
+void drawLeaderboard(void); // shows the best sessions, recent daily bests, and score percentiles
 void freeAll(void); // frees the allocated memory for all the ascii art assets and game objects
 void printLine(int row); // prints a line of dashes on the given row of the window
 void wipeWindow(void); // replaces all characters in the window with a space
 void wipeScene(void); // replaces all characters in the scene with a space
 void waitFor(unsigned int seconds, unsigned long nanoseconds); // delays processes for the given amount of time
 void drawLoading(char *loading, int columns); // draws the corresponding loading screen
-void drawIntro(void); // draws the intro (screen calibration and loading screen)
+long elapsedMs(struct timespec since); // milliseconds passed since the given time
+long elapsedUs(struct timespec since); // microseconds passed since the given time
+void drawIntro(void); // draws the intro (screen calibration and loading screen) until the assets are loaded
 void drawHomePage(void); // draws the Waste Management loading screen
 void setHomePage(void); // allows user to start game or read intructions
 void chooseGuest(void); // based on encyclopedia level, chooses an endangered species to swim over players
 void generateNewObjects(Type type); // if the current number of objects is less than the threshold, generates more
+int cullEntities(EntityStore *store, int leftEdge); // drops objects whose right edge is left of the given column
 void removeOldObjects(Type type); // if objects have gone off the left side of the screen, they are removed
 void manageObjects(void); // generates and removes any extra trash and scenery objects 
+void putHeaderText(int column, const char *text); // copies text into the middle line of the header
 void drawScore(int score, int column); // draws the score (with a leading zero if necessary)
-void drawHeader(void); // draws the header on the window (including scores, encyclopedia lvl, and endangered species found)
-void updateHeader(void); // updates encyclopedia lvl if an endangered species has emerged
+void drawHeader(void); // draws the header into its buffer (including scores, encyclopedia lvl, and endangered species found)
+void checkGuest(void); // reports the guest the moment it comes into view
 void drawShark(void); // draws the shark onto the scene
-_Bool hitTrash(int playerNo); // checks and dazes given player if they hit a trash object
-_Bool hitFish(void); // checks and dazes both players if they hit each other
-void moveFish(void); // moves both players according to WASD or IJKL inputs, player statuses, and game bounds
-void updateFish(void); // moves players and then updates their status if needed
+_Bool hitTrash(int player); // checks and dazes given player if they hit a trash object
+_Bool hitFish(int player); // checks and dazes the given player and any fish they hit
+void hashFish(void); // rebuilds the row hash of fish positions
+int keyAction(int player, char input); // turns a key press into the given player's action
+void moveFish(const int *actions); // moves every player according to their actions, player statuses, and game bounds
+void updateFish(const int *actions); // moves players and then updates their status if needed
+void buildTrashRows(void); // fills the autopilot's bit rows with the current trash
+_Bool fishCollides(int x, int y, int tick, int player); // checks a fish position against trash and the other fish at a future tick
+_Bool stepFishState(FishState *fish, int action, int tick, int player); // applies one tick of movement and daze rules, returns 1 if newly dazed
+int searchFish(FishState fish, int tick, int depth, int player); // scores the best outcome reachable within the given depth
+int autopilotInput(int player); // picks the given player's next action within the autopilot time budget
 void drawFish(void); // draws the fishes onto the scene
 void drawGuest(void); // draws the guest if they are visible on the scene
-void drawScene(void); // draws the scene onto the window
+void updateScene(const int *actions); // advances objects and players by one tick and composes the scene
+void drawScene(_Bool always); // draws the scene onto the window (always presenting it, whatever the skip level, if asked)
+void presentCurses(void); // prints the presented frame onto the window and refreshes it
+int outputQueued(void); // bytes written to the terminal that it has not taken yet
+_Bool presentDue(void); // decides whether this frame is presented or skipped
+void queueFrame(void); // hands the frame to the presenter thread
+void skipFrame(void); // keeps the frame as the latest one for the presenter to catch up on
+void presentLatest(void); // hands the latest skipped frame to the presenter
+void* presentFrames(void *unused); // presents each frame it is handed (runs on the presenter thread)
+void adaptSkipLevel(long presentMs); // raises the skip level while the terminal is congested and lowers it once it recovers
+void startPresenting(void); // starts the presenter thread
+void waitForPresenter(void); // waits until the frame being presented (and any skipped one after it) is on the terminal
+void stopPresenting(void); // finishes the last frame and stops the presenter thread
+void noteKey(void); // starts timing a key press (unless an earlier one is still waiting to be shown)
+void fileLatency(void); // records when a frame was presented and how long its key took to show
+long latencyPercentile(int percent); // microseconds within which the given share of keys were shown
+void reportLatency(void); // prints the latency distribution and frame rate
+void invalidateTerminal(void); // forgets what the ansi backend put on the terminal so the next frame is sent in full
+int appendColor(char *output, int from, int to); // appends the escape sequence that switches colors
+int appendAnsiRow(char *output, Screen *known, const Screen *frame, int row, int *pen); // appends the escape sequences that bring one terminal row up to date
+int composeFrame(char *output, Screen *known, const Screen *frame); // appends the escape sequences that bring a whole terminal up to date
+void presentAnsi(void); // sends the presented frame to the terminal with a single write()
+_Bool writeAll(int file, const char *data, int length); // writes all of the data, retrying short and interrupted writes
+_Bool startRecording(char *fileName); // opens an asciicast file (gzipped if it ends in .gz) and starts the writer thread
+void recordFrame(void); // queues the changes since the last recorded frame (dropped if the queue is full)
+int escapeJson(char *output, const char *text, int length); // writes text as the inside of a JSON string
+void* recordWriter(void *unused); // drains the recording queue to the file in batches (runs on the writer thread)
+void stopRecording(void); // flushes the queue and closes the recording
 void moveScene(void); // moves the scene forward
 
-void endGame(void); // ends game if both players are dead or either (or both) won
-void showResult(int playerNo); // displays corresponding result page with prompt to check encyclopedia if it was updated
+void endGame(void); // ends game if all players are dead or any have won
+void emitEvent(EventType type, int player, int value); // adds an event to the current tick
+void addListener(EventListener listener); // registers a consumer of every tick's events
+void dispatchEvents(void); // hands the tick's events to every listener as one batch
+void scoreEvents(const GameEvent *batch, int count); // scoring and encyclopedia rules
+void countEvents(const GameEvent *batch, int count); // telemetry
+void saveEvents(const GameEvent *batch, int count); // session log and records
+void showEvents(const GameEvent *batch, int count); // result screens
+void reportEvents(void); // prints the telemetry totals
+void rewindGame(void); // steps a practice game back and shows where it ended up
+_Bool offerRewind(void); // lets an eaten practice player rewind instead of ending the game
+void showResult(int playerNo); // displays corresponding result page with prompt to check encyclopedia if it was updated (-1 if several won)
 void saveGame(void); // saves player records to files
+void resetGame(void); // resets the players, objects, and scroll position for a new game
 void runGame(void); // resets all global variables, load in player records, and runs game
 
-int main(void){
-        srand(time(NULL)); // seed the random function with current time
+_Bool isFinished(void); // checks whether all players are dead or any have won
+void copyEntities(EntityStore *dst, const EntityStore *src); // copies only the live objects of a store
+void saveState(GameState *state); // copies the game in progress out of the globals
+void restoreState(const GameState *state); // copies a saved game back into the globals
+int putVarint(uint8_t *output, unsigned int value); // writes 7 bits per byte, low bits first
+int encodeRuns(uint8_t *output, const uint8_t *data, const uint8_t *base, int length); // run length encodes data (xored with base if given)
+void applyRuns(uint8_t *image, const uint8_t *runs, int length, _Bool delta); // decodes runs into an image (xoring them in for a delta)
+void resetRewind(void); // empties the rewind history (allocating its budget the first time)
+void dropOldestSnapshot(void); // forgets the oldest stored tick (and the deltas that need it)
+void transposeSeabed(GameState *state, _Bool toColumns); // flips a state's seabed between rows and columns
+void storeSnapshot(void); // adds the current tick to the rewind history
+_Bool rewindTicks(int ticks); // restores the game to a stored tick and forgets everything after it
+void drawRewoundScene(void); // composes the scene for a restored tick without advancing it
+Observation* envCreate(int count, const char *shmName); // creates training environments with observations in shared memory
+void envReset(int env, unsigned int seed); // starts a new game in the given environment
+void envStep(const int *p1Actions, const int *p2Actions); // advances every environment by one tick
+void envClose(void); // releases the training environments
+
+// build without main to get the training library: cc -shared -fPIC -DENV_LIBRARY p.c -o libwaste.so -lncurses -pthread
+#ifndef ENV_LIBRARY
+int main(int argc, char **argv){
+        char *recordName = NULL;
+        for (int i = 1; i < argc; i++){
+                if (strcmp(argv[i], "--ansi") == 0){
+                        ansiBackend = 1; // gameplay frames bypass curses
+                }else if (strcmp(argv[i], "--rewind") == 0 && i + 1 < argc){
+                        int budget = atoi(argv[++i]); // kilobytes of practice mode history, e.g. --rewind 256
+                        rewindBudget = (budget < MIN_REWIND_KB ? MIN_REWIND_KB : budget) * 1024;
+                }else if (strcmp(argv[i], "--max-latency") == 0 && i + 1 < argc){
+                        latencyLimitMs = atoi(argv[++i]); // fails the run if key presses take longer to show, e.g. --max-latency 50
+                }else if (strcmp(argv[i], "--mono") == 0){
+                        monochrome = 1; // no colors even if the terminal has them
+                }else if (strcmp(argv[i], "--autopilot-us") == 0 && i + 1 < argc){
+                        autopilotBudget = atol(argv[++i]) * 1000; // time the autopilot may think per tick, e.g. --autopilot-us 500
+                        autopilotBudget = autopilotBudget < 1000 ? 1000 : autopilotBudget;
+                }else if (strcmp(argv[i], "--fast-start") == 0){
+                        fastStart = 1; // no window calibration wait
+                }else if (strcmp(argv[i], "--players") == 0 && i + 1 < argc){
+                        numOfPlayers = atoi(argv[++i]); // 1 to 8 fish
+                        numOfPlayers = numOfPlayers < 1 ? 1 : numOfPlayers > MAX_PLAYERS ? MAX_PLAYERS : numOfPlayers;
+                }else if (strcmp(argv[i], "--keys") == 0 && i + 1 < argc && strlen(argv[i+1]) == 6){
+                        int player = argv[++i][0] - '1'; // e.g. --keys 3:tgfh (up, down, left, right)
+                        if (player >= 0 && player < MAX_PLAYERS){
+                                memcpy(keymaps[player], argv[i] + 2, 4);
+                        }
+                }else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc){
+                        recordName = argv[++i]; // asciicast file, e.g. --record game.cast.gz
+                }else if (strcmp(argv[i], "--bot") == 0 && i + 1 < argc){
+                        int player = atoi(argv[++i]) - 1; // e.g. --bot 2
+                        if (player >= 0 && player < MAX_PLAYERS){
+                                isBot[player] = 1;
+                        }
+                }
+        }
+        for (int i = 0; i < MAX_PLAYERS; i++){
+                isBot[i] |= keymaps[i][0] == '\0'; // players without keys are always bots
+        }
+        if (recordName != NULL && !startRecording(recordName)){
+                fprintf(stderr, "Could not open %s for recording\n", recordName);
+                return 1;
+        }
+        if (!createArena(ART_BYTES + rewindBudget + ARENA_ALIGN)){
+                fprintf(stderr, "Could not map memory for the game\n");
+                return 1;
+        }
+        randomState = time(NULL); // seed the random function with current time
         initscr(); // initializes window/screen
         cbreak(); // puts terminal in cbreak mode (to allow for single char inputs)
-        loadAssets(); // loads all ascii art and player records into the game
-        drawIntro(); // gets the player ready to start game
+        startColors(); // the water, shark, fish, and scenery get their colors
+        warmCurses(); // keeps curses from allocating during games
+        loadLoadingAssets(); // loads the loading screen art
+        pthread_t loader;
+        pthread_create(&loader, NULL, loadGameAssets, NULL); // loads the remaining art in the background
+        drawIntro(); // gets the player ready to start game while the assets load
+        pthread_join(loader, NULL);
+        checkAssets(); // exits if any art failed to load
         
         setHomePage(); // sets home page
-        freeLoadingAssets(); // frees loading screen assets
+        addListener(scoreEvents); // rules first, so the others see the updated scores
+        addListener(countEvents);
+        addListener(saveEvents);
+        addListener(showEvents); // last, since the result screen waits for the player
+        startPresenting(); // frames are written to the terminal off the game thread
         runGame(); // starts game
+        stopPresenting();
 
-        freeAssets(); // frees the memory holding all remaining assets
+        stopRecording(); // writes out any frames still queued
+        freeArena(); // frees the memory holding all the assets
         nocbreak(); // cbreak mode is disabled
         endwin(); // window/screen is closed 
+        if (skippedFrames > 0){
+                printf("Skipped %ld of %lu frames, finishing at skip level %d\n", skippedFrames, frameNumber, atomic_load(&skipLevel));
+        }
+        if (recordName != NULL){
+                printf("Recorded %ld frames to %s (%ld dropped)\n", recordedFrames, recordName, droppedFrames);
+        }
+        if (atomic_load(&recordError)){
+                fprintf(stderr, "Warning: recording to %s stopped early: %s\n", recordName, strerror(atomic_load(&recordError)));
+        }
+        reportLatency();
+        reportEvents();
+#ifdef COUNT_ALLOCATIONS
+        printf("Heap calls during gameplay: %ld\n", atomic_load(&heapCalls));
+        if (atomic_load(&heapCalls) > 0){
+                return 1;
+        }
+#endif
+        if (latencyLimitMs > 0 && latencyPercentile(99) > latencyLimitMs * 1000L){
+                printf("Key to screen latency is over the %d ms limit\n", latencyLimitMs);
+                return 1;
+        }
         return 0;
 }
+#endif
 
-char* loadArt(int rows, int cols, char *fileName){
+char* readArt(int rows, int cols, char *fileName){
         /* 2d art is loaded into 1d character arrays large enough to hod 
-           all the characters making up the art */
+           all the characters making up the art (short lines are padded with spaces).
+           A missing file (or a full arena) is only recorded in failedAsset, so this is
+           safe to call off the main thread. */
+        char *art = arenaAlloc(rows * cols * sizeof(char));
+        if (art == NULL){
+                failedAsset = fileName;
+                return NULL;
+        }
+        memset(art, ' ', rows * cols * sizeof(char));
         FILE *artFile = fopen(fileName, "r");
-        char *art = (char*)malloc(rows * cols * sizeof(char));
         if (artFile == NULL){
-                wipeWindow();
-                mvprintw(0, 0, "Error: failed to load in art assets");
-                refresh();
-                waitFor(2, 0);
-                exit(1);
+                failedAsset = fileName;
+                return art;
         }
 
-        char pixel;
+        int pixel;
         int i = 0, j = 0;
         while ((pixel = fgetc(artFile)) != EOF){
                 if (pixel == '\n'){
@@ -173,100 +729,484 @@ char* loadArt(int rows, int cols, char *fileName){
                         j = 0;
                         continue;
                 }
-                art[i * cols + j] = pixel;
+                if (i < rows && j < cols){
+                        art[i * cols + j] = pixel;
+                }
                 j++;
         }
+        fclose(artFile);
         return art;
 }
 
-void loadAssets(void){
-        // home page and loading screen art
-        homePage = loadArt(SCREEN_R, SCREEN_C, "assets/homePage.txt");
+char* loadArt(int rows, int cols, char *fileName){
+        // art is read in and the game exits right away if it could not be
+        char *art = readArt(rows, cols, fileName);
+        checkAssets();
+        return art;
+}
+
+void readColors(char *fileName){
+        /* Each line names a sprite and its color, e.g. "shark red". Like missing art, a missing
+           file or a sprite left without a color is only recorded in failedAsset. */
+        FILE *colorFile = fopen(fileName, "r");
+        char sprite[16], color[16];
+        int type, value;
+        memset(typeColors, PALETTE_SIZE, sizeof(typeColors));
+        if (colorFile == NULL){
+                failedAsset = fileName;
+                return;
+        }
+        while (fscanf(colorFile, "%15s %15s", sprite, color) == 2){
+                for (type = 0; type < TRASH && strcmp(sprite, typeNames[type]) != 0; type++);
+                for (value = 0; value < PALETTE_SIZE && strcmp(color, colorNames[value]) != 0; value++);
+                if (type < TRASH && value < PALETTE_SIZE){
+                        typeColors[type] = value;
+                }
+        }
+        fclose(colorFile);
+        for (type = 0; type < TRASH; type++){
+                if (typeColors[type] == PALETTE_SIZE){
+                        failedAsset = fileName;
+                }
+        }
+}
+
+void checkAssets(void){
+        // shows the error for any asset that failed to load
+        if (failedAsset != NULL){
+                wipeWindow();
+                mvprintw(0, 0, "Error: failed to load in art assets");
+                refresh();
+                waitFor(2, 0);
+                exit(1);
+        }
+}
+
+void loadLoadingAssets(void){
+        // loading screen art (needed before everything else for the intro)
         loading1 = loadArt(LOADING_R, LOADING1_C, "assets/loading1.txt");
         loading2 = loadArt(LOADING_R, LOADING2_C, "assets/loading2.txt");
         loading3 = loadArt(LOADING_R, LOADING3_C, "assets/loading3.txt");
-        p1Won = loadArt(PWON_R, P1WON_C, "assets/p1Won.txt");
-        p2Won = loadArt(PWON_R, P2WON_C, "assets/p2Won.txt");
-        bothWon = loadArt(BOTHWON_R, BOTHWON_C, "assets/bothWon.txt");
-        gameOver = loadArt(GAMEOVER_R, GAMEOVER_C, "assets/gameOver.txt");
+}
 
-        // player (fish) art
-        fish1 = loadArt(FISH_R, FISH_C, "assets/fish.txt");
-        fish2 = loadArt(FISH_R, FISH_C, "assets/fish.txt");
+void* loadGameAssets(void *unused){
+        /* Everything but the loading screens is read in with readArt(), which leaves
+           any error for the main thread to report. assetsLoaded is set at the end. */
+        (void)unused;
+        // home page and result art
+        homePage = readArt(SCREEN_R, SCREEN_C, "assets/homePage.txt");
+        p1Won = readArt(PWON_R, P1WON_C, "assets/p1Won.txt");
+        p2Won = readArt(PWON_R, P2WON_C, "assets/p2Won.txt");
+        bothWon = readArt(BOTHWON_R, BOTHWON_C, "assets/bothWon.txt");
+        gameOver = readArt(GAMEOVER_R, GAMEOVER_C, "assets/gameOver.txt");
+
+        // player (fish) art (the eye is filled in per player when drawn)
+        fish = readArt(FISH_R, FISH_C, "assets/fish.txt");
 
         // shark art
-        shark = loadArt(SHARK_R, SHARK_C, "assets/shark.txt");
+        shark = readArt(SHARK_R, SHARK_C, "assets/shark.txt");
 
         // trash art
-        can = loadArt(CAN_R, CAN_C, "assets/can.txt");
-        bag = loadArt(BAG_R, BAG_C, "assets/bag.txt");
-        bottle = loadArt(BOTTLE_R, BOTTLE_C, "assets/bottle.txt");
+        can = readArt(CAN_R, CAN_C, "assets/can.txt");
+        bag = readArt(BAG_R, BAG_C, "assets/bag.txt");
+        bottle = readArt(BOTTLE_R, BOTTLE_C, "assets/bottle.txt");
         
         // endangered species art
-        whale = loadArt(GUEST_R, WHALE_C, "assets/whale.txt");
-        dolphin = loadArt(GUEST_R, DOLPHIN_C, "assets/dolphin.txt");
-        turtle = loadArt(GUEST_R, TURTLE_C, "assets/turtle.txt");
+        whale = readArt(GUEST_R, WHALE_C, "assets/whale.txt");
+        dolphin = readArt(GUEST_R, DOLPHIN_C, "assets/dolphin.txt");
+        turtle = readArt(GUEST_R, TURTLE_C, "assets/turtle.txt");
 
         // scenery art
-        coral = loadArt(SCENERY_R, CORAL_C, "assets/coral.txt");
-        reef = loadArt(SCENERY_R, REEF_C, "assets/reef.txt");
-        bush = loadArt(SCENERY_R, BUSH_C, "assets/bush.txt");
-        rock = loadArt(SCENERY_R, ROCK_C, "assets/reef.txt");
-        weed1 = loadArt(SCENERY_R, WEED1_C, "assets/weed1.txt");
-        weed2 = loadArt(SCENERY_R, WEED2_C, "assets/weed2.txt");
-        weed3 = loadArt(SCENERY_R, WEED3_C, "assets/weed3.txt");
-        starfish = loadArt(SCENERY_R, STARFISH_C, "assets/starfish.txt");
-}
-
-void freeLoadingAssets(void){
-        free(loading1);
-        free(loading2);
-        free(loading3);
-}
-
-void freeAssets(void){
-        free(homePage);
-        free(p1Won);
-        free(p2Won);
-        free(bothWon);
-        free(gameOver);
-        free(fish1);
-        free(fish2);
-        free(shark);
-        free(can);
-        free(bag);
-        free(bottle);
-        free(whale);
-        free(dolphin);
-        free(turtle);
-        free(coral);
-        free(reef);
-        free(bush);
-        free(rock);
-        free(weed1);
-        free(weed2);
-        free(weed3);
-        free(starfish);
+        coral = readArt(SCENERY_R, CORAL_C, "assets/coral.txt");
+        reef = readArt(SCENERY_R, REEF_C, "assets/reef.txt");
+        bush = readArt(SCENERY_R, BUSH_C, "assets/bush.txt");
+        rock = readArt(SCENERY_R, ROCK_C, "assets/reef.txt");
+        weed1 = readArt(SCENERY_R, WEED1_C, "assets/weed1.txt");
+        weed2 = readArt(SCENERY_R, WEED2_C, "assets/weed2.txt");
+        weed3 = readArt(SCENERY_R, WEED3_C, "assets/weed3.txt");
+        starfish = readArt(SCENERY_R, STARFISH_C, "assets/starfish.txt");
+
+        // sprite colors
+        readColors("assets/colors.txt");
+
+        atomic_store(&assetsLoaded, 1);
+        return NULL;
 }
 
-void loadInfo(void){
-        /* Player records are loaded in line by line (first line
-           is p1 best, second is p2 best, and third is the encyclopedia lvl) */
-        FILE *records = fopen("assets/records.txt", "r");
+void loadAssets(void){
+        // loads everything on the calling thread
+        loadLoadingAssets();
+        loadGameAssets(NULL);
+        checkAssets();
+}
+
+_Bool createArena(size_t size){
+        // the mapping is zero filled and never grows
+        arena = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (arena == MAP_FAILED){
+                arena = NULL;
+                return 0;
+        }
+        arenaSize = size;
+        arenaUsed = 0;
+        return 1;
+}
+
+void* arenaAlloc(size_t size){
+        /* Allocations are bumped off the front of the arena. Only one thread allocates at a
+           time (the loader during the intro, the game thread after it). */
+        size_t start = (arenaUsed + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+        if (arena == NULL || start + size > arenaSize){
+                return NULL;
+        }
+        arenaUsed = start + size;
+        return arena + start;
+}
+
+void freeArena(void){
+        // every pointer into the arena is invalid after this
+        if (arena != NULL){
+                munmap(arena, arenaSize);
+                arena = NULL;
+        }
+}
+
+void warmCurses(void){
+        /* ncurses allocates a cache entry the first time each parameterized capability (cursor
+           moves, repeats, erases) is formatted, so they are all formatted once up front instead
+           of whenever a frame first happens to need one */
+        char *names[] = {"cup", "hpa", "vpa", "cuf", "cub", "cuu", "cud", "ech", "dch", "ich", "rep", "il", "dl", "indn", "rin", "csr",
+                         "setaf", "setab", "setf", "setb", "sgr"};
+        char *capability;
+        for (int i = 0; i < (int)(sizeof(names) / sizeof(names[0])); i++){
+                capability = tigetstr(names[i]);
+                if (capability != NULL && capability != (char*)-1){
+                        tiparm(capability, 1, 1);
+                }
+        }
+}
 
-        if (records == NULL){
+void startColors(void){
+        // the plain color is curses' default pair, every other color gets a pair on the blue water
+        colored = !monochrome && has_colors() && start_color() == OK;
+        backColorErase = tigetflag("bce") > 0;
+        if (colored){
+                use_default_colors();
+        }
+        for (int i = WATER; colored && i < PALETTE_SIZE; i++){
+                init_pair(i, colorForeground[i], WATER_BACKGROUND);
+        }
+}
+
+void countHeap(_Bool on){
+        // a no-op in normal builds
+#ifdef COUNT_ALLOCATIONS
+        atomic_store(&countingHeap, on);
+#else
+        (void)on;
+#endif
+}
+
+#ifdef COUNT_ALLOCATIONS
+void* malloc(size_t size){
+        // the wrappers stand in for the C library's, which do the actual work
+        if (atomic_load(&countingHeap)){
+                atomic_fetch_add(&heapCalls, 1);
+        }
+        return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size){
+        if (atomic_load(&countingHeap)){
+                atomic_fetch_add(&heapCalls, 1);
+        }
+        return __libc_calloc(count, size);
+}
+
+void* realloc(void *pointer, size_t size){
+        if (atomic_load(&countingHeap)){
+                atomic_fetch_add(&heapCalls, 1);
+        }
+        return __libc_realloc(pointer, size);
+}
+
+void free(void *pointer){
+        if (atomic_load(&countingHeap) && pointer != NULL){
+                atomic_fetch_add(&heapCalls, 1);
+        }
+        __libc_free(pointer);
+}
+#endif
+
+void loadInfo(void){
+        /* Player records are kept in the session index header, so they are read
+           straight out of the mapping (the first run copies them over from records.txt) */
+        if (!openSessions()){
                 wipeWindow();
                 mvprintw(0, 0, "Error: failed to open file records");
                 refresh();
                 waitFor(2, 0);
                 exit(1);
         }
-     
-        fscanf(records, "%d\n", &p1Highest);
-        fscanf(records, "%d\n", &p2Highest);
-        fscanf(records, "%d\n", &encyclopediaLVL);
+        memset(highest, 0, sizeof(highest));
+        highest[0] = sessionIndex->p1Highest;
+        highest[1] = sessionIndex->p2Highest;
+        encyclopediaLVL = sessionIndex->encyclopediaLVL;
+}
 
-        fclose(records);
+IndexEntry* indexEntries(void){
+        return (IndexEntry*)(sessionIndex + 1);
+}
+
+_Bool mapSessions(void){
+        /* The log is only ever read through its mapping (records are added with write()),
+           while the index is mapped writable and kept sorted in place. If either mapping
+           fails, both files are closed so the next use opens (and repairs) them again. */
+        if (sessionLog != NULL){
+                munmap(sessionLog, sessionLogSize);
+                sessionLog = NULL;
+        }
+        if (sessionIndex != NULL){
+                munmap(sessionIndex, sessionIndexSize);
+        }
+        sessionLogSize = lseek(sessionLogFile, 0, SEEK_END);
+        sessionIndexSize = lseek(sessionIndexFile, 0, SEEK_END);
+        if (sessionLogSize > 0){
+                sessionLog = mmap(NULL, sessionLogSize, PROT_READ, MAP_SHARED, sessionLogFile, 0);
+        }
+        sessionIndex = mmap(NULL, sessionIndexSize, PROT_READ | PROT_WRITE, MAP_SHARED, sessionIndexFile, 0);
+        if (sessionIndex != MAP_FAILED && sessionLog != MAP_FAILED){
+                return 1;
+        }
+        if (sessionIndex != MAP_FAILED){
+                munmap(sessionIndex, sessionIndexSize);
+        }
+        if (sessionLog != NULL && sessionLog != MAP_FAILED){
+                munmap(sessionLog, sessionLogSize);
+        }
+        sessionIndex = NULL;
+        sessionLog = NULL;
+        close(sessionLogFile);
+        close(sessionIndexFile);
+        sessionLogFile = sessionIndexFile = -1;
+        return 0;
+}
+
+int compareEntries(const void *a, const void *b){
+        const IndexEntry *x = a, *y = b;
+        if (x->score != y->score){
+                return x->score < y->score ? 1 : -1;
+        }
+        return x->session < y->session ? -1 : x->session > y->session;
+}
+
+void rebuildIndex(void){
+        // every session in the log gets an entry and the entries are sorted
+        uint32_t count = sessionLogSize / sizeof(SessionRecord);
+        ftruncate(sessionIndexFile, sizeof(IndexHeader) + count * sizeof(IndexEntry));
+        if (!mapSessions()){
+                return;
+        }
+        IndexEntry *entries = indexEntries();
+        for (uint32_t i = 0; i < count; i++){
+                entries[i].score = sessionLog[i].p1Score > sessionLog[i].p2Score ? sessionLog[i].p1Score : sessionLog[i].p2Score;
+                entries[i].session = i;
+        }
+        qsort(entries, count, sizeof(IndexEntry), compareEntries);
+        sessionIndex->count = count;
+}
+
+_Bool openSessions(void){
+        /* Both files are created on first use and the player records are copied over from
+           records.txt. A record left half written by a crash is cut off the end of the log (so
+           later records stay aligned), and if the index is missing entries (e.g. the game was
+           killed between writing the log and the index), it is rebuilt from the log. */
+        if (sessionIndex != NULL){
+                return 1;
+        }
+        sessionLogFile = open(SESSION_LOG, O_RDWR | O_CREAT | O_APPEND, 0644);
+        sessionIndexFile = open(SESSION_INDEX, O_RDWR | O_CREAT, 0644);
+        if (sessionLogFile < 0 || sessionIndexFile < 0){
+                close(sessionLogFile);
+                close(sessionIndexFile);
+                sessionLogFile = sessionIndexFile = -1;
+                return 0;
+        }
+        off_t logSize = lseek(sessionLogFile, 0, SEEK_END);
+        if (logSize % sizeof(SessionRecord) != 0){
+                ftruncate(sessionLogFile, logSize - logSize % sizeof(SessionRecord));
+        }
+
+        IndexHeader header = {INDEX_MAGIC, 0, 0, 0, 0};
+        if (pread(sessionIndexFile, &header, sizeof(header), 0) != sizeof(header) || header.magic != INDEX_MAGIC){
+                FILE *records = fopen("assets/records.txt", "r");
+                if (records != NULL){
+                        fscanf(records, "%d\n", &header.p1Highest);
+                        fscanf(records, "%d\n", &header.p2Highest);
+                        fscanf(records, "%d\n", &header.encyclopediaLVL);
+                        fclose(records);
+                }
+                header.magic = INDEX_MAGIC;
+                header.count = 0;
+                ftruncate(sessionIndexFile, 0);
+                pwrite(sessionIndexFile, &header, sizeof(header), 0);
+        }
+        if (!mapSessions()){
+                return 0;
+        }
+        if (sessionIndex->count != sessionLogSize / sizeof(SessionRecord)){
+                rebuildIndex();
+        }
+        return sessionIndex != NULL;
+}
+
+void recordSession(void){
+        /* The finished game is appended to the log, then its entry is placed by binary
+           search and the rest of the index is moved down one slot. A computer player two is
+           logged without a score, so the leaderboard only ranks people. */
+        if (!openSessions()){
+                return;
+        }
+        _Bool humanP2 = numOfPlayers > 1 && !isAutopilot[1];
+        SessionRecord record = {time(NULL), trashEvaded[0], humanP2 ? trashEvaded[1] : -1, guest.type, sceneX};
+        IndexEntry entry = {record.p1Score > record.p2Score ? record.p1Score : record.p2Score, sessionIndex->count};
+        if (write(sessionLogFile, &record, sizeof(record)) != sizeof(record)){
+                return;
+        }
+        ftruncate(sessionIndexFile, sizeof(IndexHeader) + (entry.session + 1) * sizeof(IndexEntry));
+        if (!mapSessions()){
+                return;
+        }
+
+        IndexEntry *entries = indexEntries();
+        uint32_t low = 0, high = entry.session, middle;
+        while (low < high){
+                middle = (low + high) / 2;
+                if (compareEntries(&entries[middle], &entry) < 0){
+                        low = middle + 1;
+                }else{
+                        high = middle;
+                }
+        }
+        memmove(&entries[low + 1], &entries[low], (entry.session - low) * sizeof(IndexEntry));
+        entries[low] = entry;
+        sessionIndex->count = entry.session + 1;
+}
+
+void saveRecords(void){
+        // every game saves the player records (even one that is not logged), so they match records.txt
+        if (!openSessions()){
+                return;
+        }
+        sessionIndex->p1Highest = highest[0];
+        sessionIndex->p2Highest = highest[1];
+        sessionIndex->encyclopediaLVL = encyclopediaLVL;
+}
+
+int topSessions(SessionRecord *out, int k){
+        // the best sessions are simply the front of the index
+        int found = 0;
+        IndexEntry *entries = indexEntries();
+        for (; found < k && found < (int)sessionIndex->count; found++){
+                out[found] = sessionLog[entries[found].session];
+        }
+        return found;
+}
+
+int dayBest(time_t day){
+        /* The log is in time order, so the first session of the day is found by binary
+           search and only that day's sessions are scanned */
+        struct tm date;
+        localtime_r(&day, &date);
+        date.tm_hour = 0;
+        date.tm_min = 0;
+        date.tm_sec = 0;
+        date.tm_isdst = -1;
+        time_t start = mktime(&date);
+        date.tm_mday++;
+        time_t end = mktime(&date);
+
+        uint32_t count = sessionIndex->count, low = 0, high = count, middle;
+        while (low < high){
+                middle = (low + high) / 2;
+                if (sessionLog[middle].timestamp < start){
+                        low = middle + 1;
+                }else{
+                        high = middle;
+                }
+        }
+        int best = -1;
+        for (uint32_t i = low; i < count && sessionLog[i].timestamp < end; i++){
+                if (sessionLog[i].p1Score > best){
+                        best = sessionLog[i].p1Score;
+                }
+                if (sessionLog[i].p2Score > best){
+                        best = sessionLog[i].p2Score;
+                }
+        }
+        return best;
+}
+
+int scorePercentile(int percent){
+        // the index is sorted highest first, so low percentiles are near the end
+        uint32_t count = sessionIndex->count;
+        if (count == 0){
+                return 0;
+        }
+        return indexEntries()[(uint64_t)(count - 1) * (100 - percent) / 100].score;
+}
+
+void drawLeaderboard(void){
+        // the leaderboard is drawn onto the window until Q is pressed
+        const char *guestNames[] = {"TURTLE", "DOLPHIN", "WHALE"};
+        SessionRecord best[LEADERBOARD_SIZE];
+        char date[32], p2Score[8];
+        struct tm when;
+        time_t timestamp, now = time(NULL);
+
+        if (!openSessions()){
+                return;
+        }
+        wipeWindow();
+        printLine(5);
+        mvprintw(6, 0, "\t\t\t\tLEADERBOARD (%u games played)", sessionIndex->count);
+        mvprintw(8, 0, "\t\t\t\t RANK  DATE              P1   P2   GUEST     LENGTH");
+        int found = topSessions(best, LEADERBOARD_SIZE);
+        for (int i = 0; i < found; i++){
+                timestamp = best[i].timestamp;
+                localtime_r(&timestamp, &when);
+                strftime(date, sizeof(date), "%Y-%m-%d %H:%M", &when);
+                snprintf(p2Score, sizeof(p2Score), best[i].p2Score < 0 ? "BOT" : "%3d", best[i].p2Score);
+                mvprintw(9 + i, 0, "\t\t\t\t %4d  %s  %3d  %3s  %-8s  %6d", i + 1, date, best[i].p1Score,
+                         p2Score, guestNames[best[i].guest - TURTLE], best[i].ticks);
+        }
+
+        mvprintw(21, 0, "\t\t\t\tBest of the last 7 days:");
+        for (int i = 0; i < 7; i++){
+                timestamp = now - i * 86400;
+                localtime_r(&timestamp, &when);
+                strftime(date, sizeof(date), "%a %m-%d", &when);
+                int score = dayBest(timestamp);
+                if (score < 0){
+                        mvprintw(22 + i, 0, "\t\t\t\t %s    --", date);
+                }else{
+                        mvprintw(22 + i, 0, "\t\t\t\t %s  %4d", date, score);
+                }
+        }
+        mvprintw(30, 0, "\t\t\t\tMedian score: %d    90th percentile: %d    99th percentile: %d",
+                 scorePercentile(50), scorePercentile(90), scorePercentile(99));
+
+        mvprintw(32, 0, "\t\t\t\tPress Q to exit:");
+        printLine(33);
+        refresh();
+
+        char input;
+        while (1) {
+                input = getc(stdin);
+                if (input == 'q' || input == 'Q'){
+                        break;
+                }
+        }
 }
 
 void printLine(int row){
@@ -286,12 +1226,13 @@ void wipeWindow(void){
 }
 
 void wipeScreen(void){
-        // replaces all the characters in the scene with spaces
+        // replaces all the characters in the scene with spaces (of water)
         for (int i = 0; i < SCREEN_R-3; i++){
                 for (int j = 0; j < SCREEN_C; j++){
                         scene[i][j] = ' ';
                 }
         }
+        memset(sceneColors, WATER, sizeof(sceneColors));
 }
 
 
@@ -318,20 +1259,40 @@ void drawLoading(char *loading, int columns){
         }
         printLine(49);
         refresh();
-        waitFor(1,0);
+        waitFor(0, LOADING_FRAME_MS * 1000000L);
+}
+
+long elapsedMs(struct timespec since){
+        // uses the monotonic clock so wall clock changes do not matter
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (now.tv_sec - since.tv_sec) * 1000 + (now.tv_nsec - since.tv_nsec) / 1000000;
+}
+
+long elapsedUs(struct timespec since){
+        // same clock as elapsedMs()
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return (now.tv_sec - since.tv_sec) * 1000000 + (now.tv_nsec - since.tv_nsec) / 1000;
 }
 
 void drawIntro(void){
-        // players are given a few seconds to adjust their window size before game starts loading
-        mvprintw(0, 0, "Please adjust your window and zoom in/out to see the following box appropriately:");
-        refresh();
-        waitFor(4, 0);
-        drawLoading(loading1, LOADING1_C);
-        drawLoading(loading2, LOADING2_C);
-        drawLoading(loading3, LOADING3_C);
-        drawLoading(loading1, LOADING1_C);
-        drawLoading(loading2, LOADING2_C);
-        drawLoading(loading3, LOADING3_C);
+        /* Players are given a few seconds to adjust their window size (unless fast starting),
+           then the loading screens cycle until the assets are loaded and the minimum
+           animation time has passed */
+        if (!fastStart){
+                mvprintw(0, 0, "Please adjust your window and zoom in/out to see the following box appropriately:");
+                refresh();
+                waitFor(4, 0);
+        }
+
+        char *loading[] = {loading1, loading2, loading3};
+        int columns[] = {LOADING1_C, LOADING2_C, LOADING3_C};
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; !atomic_load(&assetsLoaded) || elapsedMs(start) < MIN_INTRO_MS; i = (i + 1) % 3){
+                drawLoading(loading[i], columns[i]);
+        }
 }
 
 void drawHomePage(void){
@@ -352,10 +1313,18 @@ void setHomePage(void){
         char input;
         while (1) {
                 input = getc(stdin);
-                if (input == '\r'){
+                if (input == '\r' || input == 'g' || input == 'G' || input == '1' || input == 'd' || input == 'D' || input == 'p' || input == 'P'){
+                        garbagePatch = input == 'g' || input == 'G';
+                        practice = input == 'p' || input == 'P';
+                        for (int i = 0; i < MAX_PLAYERS; i++){
+                                isAutopilot[i] = isBot[i] || input == 'd' || input == 'D' || (input == '1' && i > 0);
+                        }
                         running = 1;
                         break;
-                } 
+                }
+                else if (input == 'b' || input == 'B'){
+                        drawLeaderboard();
+                }
                 else if (input == 'i' || input == 'I'){
                         wipeWindow();
                         printLine(15);
@@ -371,8 +1340,11 @@ void setHomePage(void){
                         mvprintw(27, 0, "\t\t\t\tThroughout your journey, you may pass by endangered species...");
                         mvprintw(28, 0, "\t\t\t\tIf you happen to find them, information about them will be added to your encyclopedia");
 
-                        mvprintw(30, 0, "\t\t\t\tPress Q to exit:");
-                        printLine(31);
+                        mvprintw(29, 0, "\t\t\t\tOn the home page, press G for a garbage patch, 1 to play alone, D to watch a demo, or B for the leaderboard");
+                        mvprintw(30, 0, "\t\t\t\tPress P to practice: Z rewinds the game 16 moves at a time");
+
+                        mvprintw(31, 0, "\t\t\t\tPress Q to exit:");
+                        printLine(32);
                         refresh();
 
                         while (1) {
@@ -390,7 +1362,7 @@ void chooseGuest(void){
         /* A guest is chosen based on encyclopedia lvl (random if lvl 3)
            to appear randomly during the game's progression */
         guest.y = 0;
-        guest.x = 150 + (rand() % 300);
+        guest.x = 150 + (rand_r(&randomState) % 300);
         if (encyclopediaLVL == 0){
                 guest.type = TURTLE;
         }else if (encyclopediaLVL == 1){
@@ -398,90 +1370,76 @@ void chooseGuest(void){
         }else if (encyclopediaLVL == 2){
                 guest.type = WHALE;
         }else{
-                guest.type = TURTLE + (rand() % 3);
+                guest.type = TURTLE + (rand_r(&randomState) % 3);
         }
 }
 
 void generateNewObjects(Type type){
         /* If the current number of objects of the given type are not at
            their threshold, then more are generated and added at the end
-           of each array of objects */
+           of each array of objects (garbage patches pack trash much closer) */
+        int n;
         if (type == TRASH){
-                while (numOfTrash < TRASH_LIMIT){
-                        numOfTrash++;
-                        if (numOfTrash == 1){
-                                trash[numOfTrash-1].x = sceneX+SCREEN_C;
+                while (trash.count < trashLimit){
+                        n = trash.count++;
+                        if (n == 0){
+                                trash.x[n] = sceneX+SCREEN_C;
+                        }else if (garbagePatch){
+                                trash.x[n] = trash.x[n-1] + (rand_r(&randomState) % 6) + 2;
                         }else{
-                                trash[numOfTrash-1].x = trash[numOfTrash-2].x + (rand() % 30) + 15;
+                                trash.x[n] = trash.x[n-1] + (rand_r(&randomState) % 30) + 15;
                         }
-                        trash[numOfTrash-1].y = 13 + (rand() % 9);
-                        trash[numOfTrash-1].type = 2 + (rand() % 3);
+                        trash.y[n] = 13 + (rand_r(&randomState) % 9);
+                        trash.type[n] = CAN + (rand_r(&randomState) % 3);
+                        trash.width[n] = typeColumns[trash.type[n]];
                 }
         }else{
-                while (numOfScenery < SCENERY_LIMIT){
-                        numOfScenery++;
-                        if (numOfScenery == 1){
-                                scenery[numOfScenery-1].x = (rand() % 15);
+                while (scenery.count < SCENERY_LIMIT){
+                        n = scenery.count++;
+                        if (n == 0){
+                                scenery.x[n] = (rand_r(&randomState) % 15);
                         }else{
-                                scenery[numOfScenery-1].x = scenery[numOfScenery-2].x + 30 + (rand() % 15);
+                                scenery.x[n] = scenery.x[n-1] + 30 + (rand_r(&randomState) % 15);
                         }
-
-                        scenery[numOfScenery-1].y = 31;
-                        scenery[numOfScenery-1].type = CORAL + (rand() % 8);
+                        scenery.y[n] = 31;
+                        scenery.type[n] = CORAL + (rand_r(&randomState) % 8);
+                        scenery.width[n] = typeColumns[scenery.type[n]];
                 }
         }
 }
 
+int cullEntities(EntityStore *store, int leftEdge){
+        /* Objects whose right edge is left of the given column are dropped by
+           compacting the survivors to the front of each array. The loop has no
+           data dependent branches, so it stays cheap with hundreds of objects.
+           Returns the number of objects removed. */
+        int kept = 0;
+        int keep;
+        for (int i = 0; i < store->count; i++){
+                keep = store->x[i] + store->width[i] >= leftEdge;
+                store->x[kept] = store->x[i];
+                store->y[kept] = store->y[i];
+                store->width[kept] = store->width[i];
+                store->type[kept] = store->type[i];
+                kept += keep;
+        }
+        int removed = store->count - kept;
+        store->count = kept;
+        return removed;
+}
+
 void removeOldObjects(Type type){
-        /* Checks if objects of the given type are off the screen. If they are
-           the count of objects to remove is increased. Then, the existing objects
-           in the corresponding array are shifted over to 'remove' the old objects. */
-        int numToRemove = 0;
-        int trashWidth;
+        /* Removes objects of the given type that are off the screen. Every piece of
+           trash that makes it past the shark is reported as evaded by each living player. */
         if (type == TRASH){
-                for (int i = 0; i < numOfTrash; i++){
-                        if (trash[i].type == CAN){
-                                trashWidth = CAN_C;
-                        }else if (trash[i].type == BAG){
-                                trashWidth = BAG_C;
-                        }else if (trash[i].type == BOTTLE){
-                                trashWidth = BOTTLE_C;
-                        }
-
-                        if (trash[i].x + trashWidth < sceneX + SHARK_C){
-                                numToRemove++;
-                                if (p1IsAlive){
-                                        p1TrashEvaded++;
-                                        if (p1TrashEvaded > p1Highest){
-                                                p1Highest++;
-                                        }
-                                }
-                                if (p2IsAlive){
-                                        p2TrashEvaded++;
-                                        if (p2TrashEvaded > p2Highest){
-                                                p2Highest++;
-                                        }
-                                }
-                        }else{
-                                break;
+                int evaded = cullEntities(&trash, sceneX + SHARK_C);
+                for (int i = 0; i < numOfPlayers && evaded > 0; i++){
+                        if (isAlive[i]){
+                                emitEvent(TRASH_EVADED, i, evaded);
                         }
                 }
-                for (int i = numToRemove; i < numOfTrash; i++){
-                        trash[i-numToRemove] = trash[i];
-                }
-                numOfTrash -= numToRemove;
         }else{
-                for (int i = 0; i < numOfScenery; i++){
-                        if (scenery[i].x < sceneX - 50){
-                                numToRemove++;
-                        }else{
-                                break;
-                        }
-                }
-                for (int i = numToRemove; i < numOfScenery; i++){
-                        scenery[i-numToRemove] = scenery[i];
-                }
-                numOfScenery -= numToRemove;
+                cullEntities(&scenery, sceneX - 50);
         }
 }
 
@@ -494,37 +1452,62 @@ void manageObjects(void){
 }
 
 
+void putHeaderText(int column, const char *text){
+        // text is cut off at the right edge of the header
+        for (int i = 0; text[i] != '\0' && column + i < SCREEN_C; i++){
+                header[1][column + i] = text[i];
+        }
+}
+
 void drawScore(int score, int column){
         // score is printed with leading 0 if needed
-        if (score < 10){
-                mvprintw(1, column, "0%d", score);
-        }else{
-                mvprintw(1, column, "%d", score);
- 
-        }
+        char text[12];
+        snprintf(text, sizeof(text), score < 10 ? "0%d" : "%d", score);
+        putHeaderText(column, text);
 }
 
 void drawHeader(void){
-        // header is printed using player recorded data
-        printLine(0);
-        mvprintw(1, 10, "P1 SCORE:");
-        mvprintw(1, 23, "BEST:");
-        mvprintw(1, 46, "LVL %d ENCYCLOPEDIA", encyclopediaLVL);
-        mvprintw(1, 79, "FOUND ?????? ??????? ?????");
+        // header is composed using player recorded data
+        char text[48];
+        memset(header[0], '-', SCREEN_C);
+        memset(header[1], ' ', SCREEN_C);
+        memset(header[2], '-', SCREEN_C);
+        putHeaderText(10, "P1 SCORE:");
+        putHeaderText(23, "BEST:");
+        snprintf(text, sizeof(text), "LVL %d ENCYCLOPEDIA", encyclopediaLVL);
+        putHeaderText(46, text);
+        putHeaderText(79, "FOUND ?????? ??????? ?????");
         if (encyclopediaLVL == 3){
-                mvprintw(1, 85, "TURTLE DOLPHIN WHALE");
+                putHeaderText(85, "TURTLE DOLPHIN WHALE");
         } else if (encyclopediaLVL == 2){
-                mvprintw(1, 85, "TURTLE DOLPHIN");
+                putHeaderText(85, "TURTLE DOLPHIN");
         } else if (encyclopediaLVL == 1){
-                mvprintw(1, 85, "TURTLE");
+                putHeaderText(85, "TURTLE");
+        }
+        putHeaderText(120, "P2 SCORE:");
+        putHeaderText(133, "BEST:");
+        drawScore(trashEvaded[0], 20);
+        drawScore(highest[0], 29);
+        drawScore(trashEvaded[1], 130);
+        drawScore(highest[1], 139);
+
+        // any players past the second get their scores on the bottom line
+        for (int i = 2; i < numOfPlayers; i++){
+                snprintf(text, sizeof(text), " P%d SCORE: %02d ", i + 1, trashEvaded[i]);
+                memcpy(&header[2][10 + (i - 2) * 24], text, strlen(text));
+        }
+
+        // practice games show how much history there is to rewind
+        if (practice){
+                snprintf(text, sizeof(text), " PRACTICE: Z TO REWIND (%d TICKS) ", snapshotCount);
+                memcpy(&header[0][10], text, strlen(text));
+        }
+
+        // a slow terminal gets its frame skipping shown on the top line
+        if (skippedFrames > 0){
+                snprintf(text, sizeof(text), " SKIP LVL %d: %ld ", atomic_load(&skipLevel), skippedFrames);
+                memcpy(&header[0][SCREEN_C - 10 - strlen(text)], text, strlen(text));
         }
-        mvprintw(1, 120, "P2 SCORE:");
-        mvprintw(1, 133, "BEST:");
-        drawScore(p1TrashEvaded, 20);
-        drawScore(p1Highest, 29);
-        drawScore(p2TrashEvaded, 130);
-        drawScore(p2Highest, 139);
-        printLine(2);
 }
 
 void drawShark(void){
@@ -533,37 +1516,36 @@ void drawShark(void){
                 for (int j = 0; j < SHARK_C; j++){
                         if (shark[i * SHARK_C + j] != ' '){
                                 scene[19+i][j] = shark[i * SHARK_C + j]; 
+                                sceneColors[19+i][j] = typeColors[SHARK];
                         }
                 }
         }
 }
 
 void drawTrash(void){
-        /* The array of trash objects is traveresed and all the objects
-           the are visible are drawn accordingly */
-        int rows, columns;
-        char *art;
-
-        for (int i = 0; i < numOfTrash; i++){
-                if (trash[i].type == CAN){
-                        rows = CAN_R;
-                        columns = CAN_C;
-                        art = can;
-                }else if (trash[i].type == BAG){
-                        rows = BAG_R;
-                        columns = BAG_C;
-                        art = bag;
-                }else if (trash[i].type == BOTTLE){
-                        rows = BOTTLE_R;
-                        columns = BOTTLE_C;
-                        art = bottle;
+        /* The trash store is traversed and every object that overlaps the 
+           visible part of the scene (right of the shark) is drawn, clipped to it */
+        int rows, columns, screenX, first, last;
+        char *art, pixel;
+        uint8_t color;
+
+        for (int i = 0; i < trash.count; i++){
+                screenX = trash.x[i] - sceneX;
+                columns = trash.width[i];
+                if (screenX >= SCREEN_C || screenX + columns <= SHARK_C){
+                        continue;
                 }
+                rows = typeRows[trash.type[i]];
+                art = *typeArt[trash.type[i]];
+                color = typeColors[trash.type[i]];
+                first = screenX < SHARK_C ? SHARK_C - screenX : 0;
+                last = screenX + columns > SCREEN_C ? SCREEN_C - screenX : columns;
 
                 for (int j = 0; j < rows; j++){
-                        for (int k = 0; k < columns; k++){
-                                if (trash[i].x+k-sceneX >= SHARK_C && trash[i].x+k+-sceneX < SCREEN_C){
-                                        scene[trash[i].y + j][trash[i].x + k - sceneX] = art[j * columns + k];
-                                }
+                        for (int k = first; k < last; k++){
+                                pixel = art[j * columns + k];
+                                scene[trash.y[i] + j][screenX + k] = pixel;
+                                sceneColors[trash.y[i] + j][screenX + k] = pixel == ' ' ? WATER : color;
                         }
                 }
         }
@@ -574,72 +1556,76 @@ void moveScene(void){
         sceneX++;
 }
 
-void drawScenery(void){
-        /* The array of scenery objects is traveresed and all the objects
-           the are visible are drawn accordingly. A line representing the floor is 
-           also drawn */
-        int rows = SCENERY_R;
-        int columns;
+void renderSeabedColumn(int column){
+        /* The given world column is cleared (leaving the '~' floor line) and every
+           scenery object covering it is painted in, later objects over earlier ones */
+        int slot = column % SEABED_C;
+        int offset, columns;
         char *art;
 
-        for (int i = 0; i < SCREEN_C; i++){
-                scene[38][i] = '~';
-        }
-
-        for (int i = 0; i < numOfScenery; i++){
-                if (scenery[i].type == CORAL){
-                        columns = CORAL_C;
-                        art = coral;
-                }else if (scenery[i].type == REEF){
-                        columns = REEF_C;
-                        art = reef;
-                }else if (scenery[i].type == BUSH){
-                        columns = BUSH_C;
-                        art = bush;
-                }else if (scenery[i].type == ROCK){
-                        columns = ROCK_C;
-                        art = rock;
-                }else if (scenery[i].type == WEED1){
-                        columns = WEED1_C;
-                        art = weed1;
-                }else if (scenery[i].type == WEED2){
-                        columns = WEED2_C;
-                        art = weed2;
-                }else if (scenery[i].type == WEED3){
-                        columns = WEED3_C;
-                        art = weed3;
-                }else if(scenery[i].type == STARFISH){ 
-                        columns = STARFISH_C;
-                        art = starfish;
+        for (int j = 0; j < SCENERY_R; j++){
+                seabed[j][slot] = ' ';
+                seabedColors[j][slot] = WATER;
+        }
+        seabed[FLOOR_Y - SEABED_Y][slot] = '~';
+        seabedColors[FLOOR_Y - SEABED_Y][slot] = YELLOW; // the sand
+
+        for (int i = 0; i < scenery.count; i++){
+                offset = column - scenery.x[i];
+                columns = scenery.width[i];
+                if (offset < 0 || offset >= columns){
+                        continue;
                 }
+                art = *typeArt[scenery.type[i]];
+                for (int j = 0; j < SCENERY_R; j++){
+                        if (art[j * columns + offset] != ' '){
+                                seabed[scenery.y[i] - SEABED_Y + j][slot] = art[j * columns + offset];
+                                seabedColors[scenery.y[i] - SEABED_Y + j][slot] = typeColors[scenery.type[i]];
+                        }
+                }
+        }
+}
 
-                for (int j = 0; j < rows; j++){
-                        for (int k = 0; k < columns; k++){
-                                if (scenery[i].x+k-sceneX >= 0 && scenery[i].x+k-sceneX < SCREEN_C && art[j * columns + k] != ' '){
-                                        scene[scenery[i].y + j][scenery[i].x + k - sceneX] = art[j * columns + k];
+void drawScenery(void){
+        /* Columns that have scrolled into view since the last frame are rendered into
+           the seabed buffer, then the visible window is copied onto the scene row by row.
+           Rows holding a fish are merged so spaces in the scenery leave the fish visible. */
+        int start = sceneX % SEABED_C;
+        int firstPart = SEABED_C - start < SCREEN_C ? SEABED_C - start : SCREEN_C;
+        char *row;
+        uint8_t *colors;
+
+        for (; seabedEnd < sceneX + SCREEN_C; seabedEnd++){
+                renderSeabedColumn(seabedEnd);
+        }
+
+        for (int j = 0; j < SCENERY_R; j++){
+                row = scene[SEABED_Y + j];
+                colors = sceneColors[SEABED_Y + j];
+                if (rowPlayers[SEABED_Y + j] != 0){
+                        for (int i = 0; i < SCREEN_C; i++){
+                                char pixel = seabed[j][(start + i) % SEABED_C];
+                                if (pixel != ' ' || SEABED_Y + j == FLOOR_Y){
+                                        row[i] = pixel;
+                                        colors[i] = seabedColors[j][(start + i) % SEABED_C];
                                 }
                         }
+                }else{
+                        memcpy(row, &seabed[j][start], firstPart);
+                        memcpy(row + firstPart, seabed[j], SCREEN_C - firstPart);
+                        memcpy(colors, &seabedColors[j][start], firstPart);
+                        memcpy(colors + firstPart, seabedColors[j], SCREEN_C - firstPart);
                 }
         }
 }
 
-_Bool hitTrash(int playerNo){
+_Bool hitTrash(int player){
         /* Trash collisions are determined by checking if trash has been drawn onto the scene
            where the player was going be */
-        Object player;
-        if (playerNo == 1){
-                player = p1;
-        }else{
-                player = p2;
-        }
-
         for (int i = 0; i < FISH_C; i++){
-                if (scene[player.y][player.x+i] != ' '){
-                        if (playerNo == 1){
-                                p1IsDazed = 1;
-                        }else{
-                                p2IsDazed = 1;
-                        }
+                if (scene[players[player].y][players[player].x+i] != ' '){
+                        isDazed[player] = 1;
+                        emitEvent(DAZED, player, -1);
                         return 1;
                 }
         }
@@ -647,146 +1633,268 @@ _Bool hitTrash(int playerNo){
         return 0;
 }
 
-_Bool hitFish(void){
-        // player collision is determined simply from their coordinates
-        int diffX = p1.x - p2.x;
-        if (diffX < 0){
-                diffX *= -1;
-        }
+_Bool hitFish(int player){
+        /* Player collision is determined simply from their coordinates. Only fish on the
+           same row can touch, so just that row's bucket of the hash is checked. */
+        unsigned int others = rowPlayers[players[player].y] & ~(1u << player);
+        _Bool hit = 0;
+        int other, diffX;
+        for (; others != 0; others &= others - 1){
+                other = __builtin_ctz(others);
+                diffX = abs(players[player].x - players[other].x);
+                if (diffX < 9){
+                        emitEvent(COLLISION, player, other);
+                        emitEvent(DAZED, player, other);
+                        if (!isDazed[other]){
+                                emitEvent(DAZED, other, player);
+                        }
+                        isDazed[player] = 1;
+                        isDazed[other] = 1;
+                        hit = 1;
+                }
+        }
+        return hit;
+}
 
-        if ((p1.y == p2.y) && diffX < 9){
-                p1IsDazed = 1;
-                p2IsDazed = 1;
-                return 1;
-        }else{
-                return 0;
+void hashFish(void){
+        // every fish's bit is set on the row it is on
+        memset(rowPlayers, 0, sizeof(rowPlayers));
+        for (int i = 0; i < numOfPlayers; i++){
+                rowPlayers[players[i].y] |= 1u << i;
         }
 }
 
-void moveFish(void){
-        // movement input is taken in
-        char c = getc(stdin);
+int keyAction(int player, char input){
+        // the player's keys are up, down, left, right (actions 1 to 4), anything else is no action
+        input = tolower(input);
+        for (int i = 0; i < 4; i++){
+                if (input == keymaps[player][i]){
+                        return i + 1;
+                }
+        }
+        return 0;
+}
 
-        /* If the player can move (alive and not dazed) the are moved up if w/i is pressed, 
-           down if s/k is pressed, right if d/l is pressed, and left if a/j is pressed. If they 
-           happen to hit each other or a piece of trash, their movement is reversed. */
-        if (!p1IsDazed && p1IsAlive){
-                if ((c == 'w' || c == 'W')){
-                        p1.y--;
-                        if (hitFish() || hitTrash(1)){
-                                p1.y++;
-                        }
-                }else if ((c == 's' || c == 'S')){
-                        p1.y++;
-                        if (hitFish() || hitTrash(1)){
-                                p1.y--;
-                        }
-                }else if ((c == 'a' || c == 'A')){
-                        p1.x--;
-                        if (hitFish() || hitTrash(1)){
-                                p1.x++;
-                        }
-                }else if ((c == 'd' || c == 'D')){
-                        p1.x++;
-                        if (hitFish() || hitTrash(1)){
-                                p1.x--;
-                        }
-                }else{
-                        hitFish();
-                        hitTrash(1);
+void moveFish(const int *actions){
+        /* Each player that can move (alive and not dazed) is moved up, down, left, or right by
+           their action. If they happen to hit another fish or a piece of trash, their movement
+           is reversed. The row hash is kept up to date as fish change rows. */
+        int x, y;
+        for (int i = 0; i < numOfPlayers; i++){
+                if (isDazed[i] || !isAlive[i]){
+                        continue;
+                }
+                x = players[i].x;
+                y = players[i].y;
+                rowPlayers[y] &= ~(1u << i);
+                players[i].x += actionX[actions[i]];
+                players[i].y += actionY[actions[i]];
+                if (hitFish(i) || hitTrash(i)){
+                        players[i].x = x;
+                        players[i].y = y;
                 }
+                rowPlayers[players[i].y] |= 1u << i;
         }
+}
 
-        if (!p2IsDazed && p2IsAlive){
-                if ((c == 'i' || c == 'I')){
-                        p2.y--;
-                        if (hitFish() || hitTrash(2)){
-                                p2.y++;
+void updateFish(const int *actions){
+        // fishes are moved
+        moveFish(actions);
+
+        // updates the each fish's status (and eyes if needed) and keeps them in bounds
+        for (int i = 0; i < numOfPlayers; i++){
+                if (players[i].x < SHARK_C){
+                        if (isAlive[i]){
+                                emitEvent(EATEN, i, 0);
                         }
-                }else if ((c == 'k' || c == 'K')){
-                        p2.y++;
-                        if (hitFish() || hitTrash(2)){
-                                p2.y--;
+                        isAlive[i] = 0;
+                        players[i].x--;
+                        fishEyes[i] = 'X';
+                }else if (isDazed[i]){
+                        players[i].x--;
+                        dazedCount[i]++;
+                        fishEyes[i] = '@';
+                        if (dazedCount[i] == 5){
+                                isDazed[i] = 0;
+                                dazedCount[i] = 0;
+                                fishEyes[i] = 'o';
                         }
-                }else if ((c == 'j' || c == 'J')){
-                        p2.x--;
-                        if (hitFish() || hitTrash(2)){
-                                p2.x++;
+                }else{
+                        if (players[i].y < 13){
+                                players[i].y++;
+                        }else if (players[i].y > 31){
+                                players[i].y--;
+                        }else if (players[i].x > SCREEN_C - FISH_C){
+                                players[i].x--;
                         }
-                }else if ((c == 'l' || c == 'L')){
-                        p2.x++;
-                        if (hitFish() || hitTrash(2)){
-                                p2.x--;
+                }
+        }
+}
+
+void buildTrashRows(void){
+        /* every visible character of every trash object sets its bit (objects past the last
+           word are skipped, so a full garbage patch costs little more than the visible trash) */
+        int rows, columns, bit;
+        char *art;
+
+        memset(trashRows, 0, sizeof(trashRows));
+        for (int i = 0; i < trash.count; i++){
+                if (trash.x[i] - sceneX >= 64 * BITBOARD_WORDS || trash.x[i] + trash.width[i] <= sceneX){
+                        continue;
+                }
+                rows = typeRows[trash.type[i]];
+                columns = trash.width[i];
+                art = *typeArt[trash.type[i]];
+                for (int j = 0; j < rows; j++){
+                        for (int k = 0; k < columns; k++){
+                                bit = trash.x[i] + k - sceneX;
+                                if (bit >= 0 && bit < 64 * BITBOARD_WORDS && art[j * columns + k] != ' '){
+                                        trashRows[trash.y[i] + j][bit >> 6] |= (uint64_t)1 << (bit & 63);
+                                }
                         }
-                }else{
-                        hitFish();
-                        hitTrash(2);
                 }
         }
 }
 
-void updateFish(void){
-        // fishes are moved
-        moveFish();
+_Bool fishCollides(int x, int y, int tick, int player){
+        /* Mirrors hitFish() and hitTrash() for the given player's fish at (x, y) the given number
+           of ticks from now. The scene scrolls one column per tick, so the trash under the fish is
+           found by shifting the bit row by the tick and testing the 8 bits the fish covers. */
+        for (unsigned int others = rowPlayers[y] & ~(1u << player); others != 0; others &= others - 1){
+                if (abs(x - players[__builtin_ctz(others)].x) < 9){
+                        return 1;
+                }
+        }
 
-        // updates the each fish's status (and eyes if needed) and keeps them in bounds
-        if (p1.x < SHARK_C){
-                p1IsAlive = 0;
-                p1.x--;
-                fish1[5] = 'X';
-        }else if (p1IsDazed){
-                p1.x--;
-                p1DazedCount++;
-                fish1[5] = '@';
-                if (p1DazedCount == 5){
-                        p1IsDazed = 0;
-                        p1DazedCount = 0;
-                        fish1[5] = 'o';
+        int bit = x + tick;
+        int word = bit >> 6, offset = bit & 63;
+        uint64_t span = trashRows[y][word] >> offset;
+        if (offset != 0 && word + 1 < BITBOARD_WORDS){
+                span |= trashRows[y][word + 1] << (64 - offset);
+        }
+        return (span & 0xFF) != 0;
+}
+
+_Bool stepFishState(FishState *fish, int action, int tick, int player){
+        // one tick of moveFish() and updateFish() for a single fish (action 0 none, 1 up, 2 down, 3 left, 4 right)
+        _Bool dazed = 0;
+        if (!fish->isDazed && fish->isAlive){
+                int x = fish->x + actionX[action];
+                int y = fish->y + actionY[action];
+                if (fishCollides(x, y, tick, player)){
+                        fish->isDazed = 1;
+                        dazed = 1;
+                }else{
+                        fish->x = x;
+                        fish->y = y;
                 }
-        }else{
-                if (p1.y < 13){
-                        p1.y++;
-                }else if (p1.y > 31){
-                        p1.y--;;
-                }else if (p1.x > SCREEN_C - FISH_C){
-                        p1.x--;
-                }
-        }
-
-        if (p2.x < + SHARK_C){
-                p2IsAlive = 0;
-                p2.x--;
-                fish2[5] = 'X';
-        }else if (p2IsDazed){
-                p2.x--;
-                p2DazedCount++;
-                fish2[5] = '@';
-                if (p2DazedCount == 5){
-                        p2IsDazed = 0;
-                        p2DazedCount = 0;
-                        fish2[5] = 'o';
+        }
+
+        if (fish->x < SHARK_C){
+                fish->isAlive = 0;
+                fish->x--;
+        }else if (fish->isDazed){
+                fish->x--;
+                fish->dazedCount++;
+                if (fish->dazedCount == 5){
+                        fish->isDazed = 0;
+                        fish->dazedCount = 0;
                 }
         }else{
-                if (p2.y < 13){
-                        p2.y++;
-                }else if (p2.y > 31){
-                        p2.y--;;
-                }else if (p2.x > SCREEN_C - FISH_C){
-                        p2.x--;
+                if (fish->y < 13){
+                        fish->y++;
+                }else if (fish->y > 31){
+                        fish->y--;
+                }else if (fish->x > SCREEN_C - FISH_C){
+                        fish->x--;
                 }
         }
+        return dazed;
 }
 
-void drawFish(void){
-        // Both fish are drawn onto the scene
-        for (int i = 0; i < FISH_C; i++){
-                if (p1.x+i >= 21) {
-                        scene[p1.y][p1.x+i] = fish1[i];
+int searchFish(FishState fish, int tick, int depth, int player){
+        /* Depth first search over the five actions. Getting eaten is worst (later is less bad),
+           each daze costs a penalty, and surviving positions are scored by their distance
+           from the shark. A dazed fish ignores input, so it only has one move to try. */
+        if (!fish.isAlive){
+                return -100000 + tick * 100;
+        }
+        if (depth == 0){
+                return fish.x - (fish.isDazed ? 20 : 0);
+        }
+        if ((++autopilotNodes & 63) == 0){
+                struct timespec now;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                if (now.tv_sec > autopilotDeadline.tv_sec || (now.tv_sec == autopilotDeadline.tv_sec && now.tv_nsec >= autopilotDeadline.tv_nsec)){
+                        autopilotOutOfTime = 1;
                 }
-                if (p2.x+i >= 21) {
-                        scene[p2.y][p2.x+i] = fish2[i];
+        }
+        if (autopilotOutOfTime){
+                return 0;
+        }
+
+        int best = -1000000, value;
+        int actions = fish.isDazed ? 1 : 5;
+        FishState next;
+        for (int action = 0; action < actions; action++){
+                next = fish;
+                value = stepFishState(&next, action, tick, player) ? -500 : 0;
+                value += searchFish(next, tick + 1, depth - 1, player);
+                if (value > best){
+                        best = value;
                 }
         }
+        return best;
+}
+
+int autopilotInput(int player){
+        /* Iterative deepening: searches one tick further each round and keeps the best first
+           move of the last round that finished before the time budget ran out. The other
+           fish are assumed to stay where they are. The budget covers building the bit rows too. */
+        FishState fish = {players[player].x, players[player].y, dazedCount[player], isDazed[player], isAlive[player]};
+
+        clock_gettime(CLOCK_MONOTONIC, &autopilotDeadline);
+        autopilotDeadline.tv_nsec += autopilotBudget;
+        autopilotDeadline.tv_sec += autopilotDeadline.tv_nsec / 1000000000;
+        autopilotDeadline.tv_nsec %= 1000000000;
+        buildTrashRows();
+        autopilotOutOfTime = 0;
+        autopilotNodes = 0;
+        autopilotDepthReached = 0;
+
+        int bestAction = 0, roundBest, best, value;
+        FishState next;
+        for (int depth = 1; depth <= autopilotMaxDepth && !autopilotOutOfTime; depth++){
+                roundBest = 0;
+                best = -1000000;
+                for (int action = 0; action < 5; action++){
+                        next = fish;
+                        value = stepFishState(&next, action, 0, player) ? -500 : 0;
+                        value += searchFish(next, 1, depth - 1, player);
+                        if (value > best){
+                                best = value;
+                                roundBest = action;
+                        }
+                }
+                if (!autopilotOutOfTime){
+                        bestAction = roundBest;
+                        autopilotDepthReached = depth;
+                }
+        }
+        return bestAction;
+}
+
+void drawFish(void){
+        // every fish is drawn onto the scene with its eye, then the row hash is brought up to date
+        for (int i = 0; i < numOfPlayers; i++){
+                for (int j = 0; j < FISH_C; j++){
+                        if (players[i].x+j >= 21) {
+                                scene[players[i].y][players[i].x+j] = j == 5 ? fishEyes[i] : fish[j];
+                                sceneColors[players[i].y][players[i].x+j] = playerColors[i];
+                        }
+                }
+        }
+        hashFish();
 }
 
 void drawGuest(void){
@@ -808,39 +1916,575 @@ void drawGuest(void){
                 for (int j = 0; j < guestWidth; j++){
                         if (guest.x + j - sceneX >= 0 && guest.x + j - sceneX < 150){
                                 scene[i][guest.x + j - sceneX] = art[i * guestWidth + j];
+                                sceneColors[i][guest.x + j - sceneX] = art[i * guestWidth + j] == ' ' ? WATER : typeColors[guest.type];
                         }
                 }
         }       
 }
 
-void drawScene(void){
-        /* The scene is wiped before the trash is drawn. Then the fish are locations updated the trash 
-           on the scene to determine collisions. Then, after any fish movement has occured and/or their status
-           has changed, the shark is drawn onto the scene. Then the header is updated and drawn as well. After all
-           that, the scenery (decoration) and guest are drawn if the are visible on the screen. Finally, everything
-           is printed onto the window and it is refreshed. */
+void updateScene(const int *actions){
+        /* Objects are generated/removed and the scene is wiped before the trash is drawn. Then the
+           fish locations are updated using the trash on the scene to determine collisions. Then, after
+           any fish movement has occured and/or their status has changed, the shark is drawn onto the
+           scene and the guest is checked for. After all that, the scenery (decoration) and guest are drawn
+           if the are visible on the screen, and the tick's events are handed to the listeners. Nothing
+           here touches the window. */
+        manageObjects();
         wipeScreen();
         drawTrash();
-        updateFish();
+        updateFish(actions);
         drawFish();
         drawShark();
-        updateHeader();
-        drawHeader();
+        checkGuest();
         drawScenery();
         drawGuest();
-        for (int i = 0; i < SCREEN_R-3; i++){
-                for (int j = 0; j < SCREEN_C; j++){
-                        mvprintw(i+3, j, "%c", scene[i][j]);
+        dispatchEvents();
+}
+
+void drawScene(_Bool always){
+        // the header and the composed scene are presented unless the terminal is backed up (or the frame has to be seen)
+        drawHeader();
+        memcpy(frameScreen.cells, header, sizeof(header));
+        memcpy(frameScreen.cells + 3, scene, (SCREEN_R - 3) * SCREEN_C);
+        memset(frameScreen.colors, PLAIN, sizeof(header));
+        if (colored){
+                memcpy(frameScreen.colors + 3, sceneColors, sizeof(sceneColors));
+        }else{
+                memset(frameScreen.colors + 3, PLAIN, sizeof(sceneColors));
+        }
+        if (recordFile >= 0){
+                recordFrame();
+        }
+        if (always){
+                frameNumber++;
+                waitForPresenter();
+                queueFrame();
+        }else if (presentDue()){
+                queueFrame();
+        }else{
+                skipFrame();
+        }
+}
+
+void presentCurses(void){
+        /* Each row goes to curses as runs of cells sharing a color, so the color is switched
+           once per run rather than per cell, and curses works out what changed when refreshing.
+           A blank on the water looks the same in every water color, so it joins the run it is
+           in (curses sends both colors on every switch, which made color frames twice the size). */
+        char run[SCREEN_C + 1];
+        int length;
+        uint8_t color, next;
+        for (int i = 0; i < SCREEN_R; i++){
+                for (int j = 0; j < SCREEN_C; j += length){
+                        color = presentScreen.colors[i][j];
+                        for (length = 0; j + length < SCREEN_C; length++){
+                                next = presentScreen.colors[i][j + length];
+                                if (next != color && (color == PLAIN || next == PLAIN || presentScreen.cells[i][j + length] != ' ')){
+                                        break;
+                                }
+                                run[length] = presentScreen.cells[i][j + length] < ' ' ? ' ' : presentScreen.cells[i][j + length];
+                        }
+                        run[length] = '\0';
+                        attrset(COLOR_PAIR(color));
+                        mvaddstr(i, j, run);
                 }
         }
+        attrset(A_NORMAL);
         refresh();
 }
 
-void updateHeader(void){
-        // if the guest has shown up, the encyclopedia's lvl is incremented
-        if (sceneX+SCREEN_C-guest.x == 0 && encyclopediaLVL < 3){
-                encyclopediaLVL++;
-                encyclopediaLeveledUp = 1;
+int outputQueued(void){
+        // nothing counts as queued when the output is not a terminal
+        int queued = 0;
+        if (ioctl(STDOUT_FILENO, TIOCOUTQ, &queued) != 0){
+                return 0;
+        }
+        return queued;
+}
+
+_Bool presentDue(void){
+        /* Frames are presented on the skip level's stride, as long as the presenter is free
+           and the terminal holds no more than the high water mark */
+        frameNumber++;
+        if (atomic_load(&framePending) || frameNumber % (1UL << atomic_load(&skipLevel)) != 0){
+                return 0;
+        }
+        return outputQueued() <= OUTPUT_HIGH_WATER;
+}
+
+void queueFrame(void){
+        /* The presenter may have caught up on a skipped frame since presentDue() looked, and
+           then its copy is in use, so this frame becomes the latest one instead */
+        pthread_mutex_lock(&presentLock);
+        if (atomic_load(&framePending)){
+                pthread_mutex_unlock(&presentLock);
+                skipFrame();
+                return;
+        }
+        memcpy(&presentScreen, &frameScreen, sizeof(Screen));
+        presentHasKey = keyWaiting || latestHasKey;
+        presentKeyTime = latestHasKey ? latestKeyTime : keyTime;
+        keyWaiting = 0;
+        latestHasKey = 0;
+        latestPending = 0; // this frame is newer than any skipped one
+        atomic_store(&framePending, 1);
+        pthread_cond_broadcast(&presentChanged);
+        pthread_mutex_unlock(&presentLock);
+}
+
+void skipFrame(void){
+        // a key skipped with an earlier frame keeps its older time
+        pthread_mutex_lock(&presentLock);
+        memcpy(&latestScreen, &frameScreen, sizeof(Screen));
+        if (keyWaiting && !latestHasKey){
+                latestHasKey = 1;
+                latestKeyTime = keyTime;
+        }
+        keyWaiting = 0;
+        if (!latestPending){
+                latestPending = 1;
+                pthread_cond_broadcast(&presentChanged); // an idle presenter starts its catch up wait
+        }
+        pthread_mutex_unlock(&presentLock);
+        skippedFrames++;
+}
+
+void presentLatest(void){
+        // called with presentLock held and no frame pending
+        memcpy(&presentScreen, &latestScreen, sizeof(Screen));
+        presentHasKey = latestHasKey;
+        presentKeyTime = latestKeyTime;
+        latestHasKey = 0;
+        latestPending = 0;
+        atomic_store(&framePending, 1);
+        pthread_cond_broadcast(&presentChanged);
+}
+
+void* presentFrames(void *unused){
+        // each frame is timed so the skip level can follow how well the terminal is keeping up
+        struct timespec start, deadline;
+        (void)unused;
+        pthread_mutex_lock(&presentLock);
+        while (1){
+                while (presenting && !atomic_load(&framePending)){
+                        if (!latestPending){
+                                pthread_cond_wait(&presentChanged, &presentLock);
+                                continue;
+                        }
+                        clock_gettime(CLOCK_REALTIME, &deadline);
+                        deadline.tv_nsec += CATCH_UP_MS * 1000000L;
+                        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+                        deadline.tv_nsec %= 1000000000L;
+                        if (pthread_cond_timedwait(&presentChanged, &presentLock, &deadline) == ETIMEDOUT
+                            && latestPending && !atomic_load(&framePending)){
+                                presentLatest();
+                        }
+                }
+                if (!atomic_load(&framePending) && latestPending){
+                        presentLatest(); // the last frame is shown before the thread stops
+                }
+                if (!atomic_load(&framePending)){
+                        break;
+                }
+                pthread_mutex_unlock(&presentLock);
+
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                if (ansiBackend){
+                        presentAnsi();
+                }else{
+                        presentCurses();
+                }
+                adaptSkipLevel(elapsedMs(start));
+                fileLatency();
+
+                pthread_mutex_lock(&presentLock);
+                atomic_store(&framePending, 0);
+                if (latestPending){
+                        presentLatest(); // frames were skipped while this one was written
+                }else{
+                        pthread_cond_broadcast(&presentChanged);
+                }
+        }
+        pthread_mutex_unlock(&presentLock);
+        return NULL;
+}
+
+void adaptSkipLevel(long presentMs){
+        // a slow or backed up present doubles the stride, a long run of quick ones halves it
+        int level = atomic_load(&skipLevel);
+        if (presentMs > PRESENT_SLOW_MS || outputQueued() > OUTPUT_HIGH_WATER){
+                calmPresents = 0;
+                if (level < MAX_SKIP_LEVEL){
+                        atomic_store(&skipLevel, level + 1);
+                }
+        }else if (++calmPresents >= RECOVER_PRESENTS){
+                calmPresents = 0;
+                if (level > 0){
+                        atomic_store(&skipLevel, level - 1);
+                }
+        }
+}
+
+void startPresenting(void){
+        // the presenter waits for its first frame
+        presenting = 1;
+        pthread_create(&presentThread, NULL, presentFrames, NULL);
+}
+
+void waitForPresenter(void){
+        // curses is only used by one thread at a time, so other screens wait for the presenter
+        pthread_mutex_lock(&presentLock);
+        if (latestPending && !atomic_load(&framePending)){
+                presentLatest();
+        }
+        while (atomic_load(&framePending)){
+                pthread_cond_wait(&presentChanged, &presentLock);
+        }
+        pthread_mutex_unlock(&presentLock);
+}
+
+void noteKey(void){
+        // the oldest key not yet on screen is the one that has waited longest
+        if (!keyWaiting){
+                clock_gettime(CLOCK_MONOTONIC, &keyTime);
+                keyWaiting = 1;
+        }
+}
+
+void fileLatency(void){
+        // runs on the presenter thread right after a frame is written
+        clock_gettime(CLOCK_MONOTONIC, &lastPresent);
+        if (presentedFrames++ == 0){
+                firstPresent = lastPresent;
+        }
+        if (!presentHasKey){
+                return;
+        }
+        long latency = elapsedUs(presentKeyTime);
+        int bucket = latency / LATENCY_BUCKET_US;
+        latencyCounts[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1]++;
+        latencySamples++;
+        maxLatencyUs = latency > maxLatencyUs ? latency : maxLatencyUs;
+}
+
+long latencyPercentile(int percent){
+        // the upper edge of the bucket holding the percentile (the slowest bucket reports the maximum)
+        long needed = (latencySamples * percent + 99) / 100, seen = 0;
+        for (int i = 0; i < LATENCY_BUCKETS - 1; i++){
+                seen += latencyCounts[i];
+                if (seen >= needed){
+                        return (i + 1) * LATENCY_BUCKET_US;
+                }
+        }
+        return maxLatencyUs;
+}
+
+void reportLatency(void){
+        // frame rate is taken over the span from the first presented frame to the last
+        double seconds = (lastPresent.tv_sec - firstPresent.tv_sec) + (lastPresent.tv_nsec - firstPresent.tv_nsec) / 1e9;
+        if (latencySamples > 0){
+                printf("Key to screen latency over %ld keys: p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+                       latencySamples, latencyPercentile(50) / 1000.0, latencyPercentile(90) / 1000.0,
+                       latencyPercentile(99) / 1000.0, maxLatencyUs / 1000.0);
+        }
+        if (presentedFrames > 1 && seconds > 0){
+                printf("Presented %ld frames at %.1f frames per second\n", presentedFrames, (presentedFrames - 1) / seconds);
+        }
+}
+
+void stopPresenting(void){
+        // a pending frame is still presented before the thread exits
+        pthread_mutex_lock(&presentLock);
+        presenting = 0;
+        pthread_cond_broadcast(&presentChanged);
+        pthread_mutex_unlock(&presentLock);
+        pthread_join(presentThread, NULL);
+}
+
+void invalidateTerminal(void){
+        // no shown cell is ever a zero, so every cell is resent
+        memset(&terminalScreen, 0, sizeof(Screen));
+}
+
+int appendColor(char *output, int from, int to){
+        // moving between two colors on the water only changes the foreground
+        if (to == PLAIN){
+                return sprintf(output, "\033[0m");
+        }else if (from == PLAIN){
+                return sprintf(output, "\033[3%d;4%dm", colorForeground[to], WATER_BACKGROUND);
+        }
+        return sprintf(output, "\033[3%dm", colorForeground[to]);
+}
+
+int appendAnsiRow(char *output, Screen *known, const Screen *frame, int row, int *pen){
+        /* Runs of changed cells (a different character or color) are found and each one is sent
+           as a cursor move followed by its characters (the first move in a row is absolute, later
+           ones are the shorter move forward). Unchanged gaps shorter than a cursor move are sent
+           as part of the run instead, since that is fewer bytes. The pen is the color the terminal
+           is writing in, and it is only switched where a cell's color differs from the one before
+           it, so a run of one color costs one switch. Rows that scrolled left by a column are
+           first shifted on the terminal by deleting the character at their first change, in the
+           color the terminal will fill the column opened on the right with (the row's last color
+           if it fills with the current color, otherwise plain). Control characters
+           are shown as spaces so the terminal cursor stays in step. The known row is updated to
+           match. Returns the number of bytes appended. */
+        char shown[SCREEN_C];
+        char *knownCells = known->cells[row];
+        uint8_t *knownColors = known->colors[row];
+        const uint8_t *colors = frame->colors[row];
+        int length = 0, start, end, gap, cursor = -1;
+        int first = SCREEN_C, direct = 0, shifted = 0;
+        int blank = backColorErase ? colors[SCREEN_C - 1] : PLAIN;
+        for (int k = 0; k < SCREEN_C; k++){
+                shown[k] = frame->cells[row][k] < ' ' ? ' ' : frame->cells[row][k];
+                if ((shown[k] != knownCells[k] || colors[k] != knownColors[k]) && first == SCREEN_C){
+                        first = k;
+                }
+        }
+        if (first == SCREEN_C){
+                return 0;
+        }
+
+        for (int k = first; k < SCREEN_C; k++){
+                direct += shown[k] != knownCells[k] || colors[k] != knownColors[k];
+                if (k + 1 < SCREEN_C){
+                        shifted += shown[k] != knownCells[k + 1] || colors[k] != knownColors[k + 1];
+                }else{
+                        shifted += shown[k] != ' ' || colors[k] != blank;
+                }
+        }
+        if (shifted + ANSI_MERGE_GAP < direct){
+                if (*pen != blank){
+                        length += appendColor(output, *pen, blank);
+                        *pen = blank;
+                }
+                length += sprintf(output + length, "\033[%d;%dH\033[P", row + 1, first + 1);
+                memmove(knownCells + first, knownCells + first + 1, SCREEN_C - first - 1);
+                memmove(knownColors + first, knownColors + first + 1, SCREEN_C - first - 1);
+                knownCells[SCREEN_C - 1] = ' ';
+                knownColors[SCREEN_C - 1] = blank;
+                cursor = first;
+        }
+
+        int j = first;
+        while (j < SCREEN_C){
+                if (shown[j] == knownCells[j] && colors[j] == knownColors[j]){
+                        j++;
+                        continue;
+                }
+                start = j;
+                end = j + 1;
+                gap = 0;
+                for (j++; j < SCREEN_C && gap <= ANSI_MERGE_GAP; j++){
+                        if (shown[j] == knownCells[j] && colors[j] == knownColors[j]){
+                                gap++;
+                        }else{
+                                gap = 0;
+                                end = j + 1;
+                        }
+                }
+                j = end;
+                if (cursor < 0){
+                        length += sprintf(output + length, "\033[%d;%dH", row + 1, start + 1);
+                }else if (start > cursor){
+                        length += sprintf(output + length, "\033[%dC", start - cursor);
+                }
+                for (int k = start; k < end; k++){
+                        if (colors[k] != *pen){
+                                length += appendColor(output + length, *pen, colors[k]);
+                                *pen = colors[k];
+                        }
+                        output[length++] = shown[k];
+                }
+                memcpy(knownCells + start, shown + start, end - start);
+                memcpy(knownColors + start, colors + start, end - start);
+                cursor = end;
+        }
+        return length;
+}
+
+int composeFrame(char *output, Screen *known, const Screen *frame){
+        /* every changed span of the frame goes into the buffer, then the colors are put back to
+           plain (so each frame starts from them) and the cursor is parked in the corner */
+        int length = 0, pen = PLAIN;
+        for (int i = 0; i < SCREEN_R; i++){
+                length += appendAnsiRow(output + length, known, frame, i, &pen);
+        }
+        if (pen != PLAIN){
+                length += appendColor(output + length, pen, PLAIN);
+        }
+        length += sprintf(output + length, "\033[%d;%dH", SCREEN_R, SCREEN_C - 1);
+        return length;
+}
+
+void presentAnsi(void){
+        // the frame is sent with one write() (more only if the terminal takes part of it)
+        int length = composeFrame(ansiOutput, &terminalScreen, &presentScreen);
+        if (!writeAll(STDOUT_FILENO, ansiOutput, length)){
+                invalidateTerminal(); // whatever did reach the terminal is unknown, so the next frame is sent in full
+        }
+}
+
+_Bool writeAll(int file, const char *data, int length){
+        // returns 0 if the write failed for any reason other than a signal
+        ssize_t written;
+        while (length > 0){
+                written = write(file, data, length);
+                if (written < 0){
+                        if (errno == EINTR){
+                                continue;
+                        }
+                        return 0;
+                }
+                data += written;
+                length -= written;
+        }
+        return 1;
+}
+
+_Bool startRecording(char *fileName){
+        /* The asciicast header goes out first. A .gz recording is piped through gzip,
+           which runs as a child process writing to the file. */
+        int file = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (file < 0){
+                return 0;
+        }
+        size_t nameLength = strlen(fileName);
+        if (nameLength > 3 && strcmp(fileName + nameLength - 3, ".gz") == 0){
+                int pipeFiles[2];
+                if (pipe(pipeFiles) != 0){
+                        return 0;
+                }
+                recordCompressor = fork();
+                if (recordCompressor == 0){
+                        dup2(pipeFiles[0], STDIN_FILENO);
+                        dup2(file, STDOUT_FILENO);
+                        close(pipeFiles[1]);
+                        execlp("gzip", "gzip", "-c", (char*)NULL);
+                        _exit(1);
+                }
+                close(pipeFiles[0]);
+                close(file);
+                file = pipeFiles[1];
+        }
+        recordFile = file;
+        signal(SIGPIPE, SIG_IGN); // a gzip that died (or was never installed) shows up as EPIPE rather than killing the game
+
+        char headerLine[128];
+        int length = sprintf(headerLine, "{\"version\": 2, \"width\": %d, \"height\": %d, \"timestamp\": %ld}\n",
+                             SCREEN_C, SCREEN_R, (long)time(NULL));
+        writeAll(recordFile, headerLine, length); // a failure here is seen again by the writer
+
+        memset(&recordScreen, 0, sizeof(Screen));
+        clock_gettime(CLOCK_MONOTONIC, &recordStart);
+        atomic_store(&recording, 1);
+        pthread_create(&recordThread, NULL, recordWriter, NULL);
+        return 1;
+}
+
+void recordFrame(void){
+        // the frame is composed straight into the next free slot, or dropped if there is none
+        if (atomic_load(&recordError)){
+                return;
+        }
+        unsigned int head = atomic_load_explicit(&recordHead, memory_order_relaxed);
+        unsigned int tail = atomic_load_explicit(&recordTail, memory_order_acquire);
+        if (head - tail == RECORD_QUEUE_SIZE){
+                droppedFrames++;
+                lastFrameDropped = 1;
+                memset(&recordScreen, 0, sizeof(Screen)); // the next recorded frame has to be complete
+                return;
+        }
+
+        RecordedFrame *frame = &recordQueue[head % RECORD_QUEUE_SIZE];
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        frame->time = (now.tv_sec - recordStart.tv_sec) + (now.tv_nsec - recordStart.tv_nsec) / 1e9;
+        frame->length = composeFrame(frame->data, &recordScreen, &frameScreen);
+        recordedFrames++;
+        lastFrameDropped = 0;
+        atomic_store_explicit(&recordHead, head + 1, memory_order_release);
+}
+
+int escapeJson(char *output, const char *text, int length){
+        // quotes, backslashes, and control characters (the escape sequences) are escaped
+        int written = 0;
+        for (int i = 0; i < length; i++){
+                unsigned char c = text[i];
+                if (c == '"' || c == '\\'){
+                        output[written++] = '\\';
+                        output[written++] = c;
+                }else if (c < ' '){
+                        written += sprintf(output + written, "\\u%04x", c);
+                }else{
+                        output[written++] = c;
+                }
+        }
+        return written;
+}
+
+void* recordWriter(void *unused){
+        /* Every frame in the queue is turned into an asciicast output event and the events are
+           written out together, once the batch fills up or the queue runs dry. With nothing
+           queued the writer naps briefly. If a write fails the writer records why and stops. */
+        (void)unused;
+        unsigned int head, tail;
+        int length = 0;
+        while (1){
+                tail = atomic_load_explicit(&recordTail, memory_order_relaxed);
+                head = atomic_load_explicit(&recordHead, memory_order_acquire);
+                if (tail == head){
+                        if (length > 0 && !writeAll(recordFile, recordBatch, length)){
+                                atomic_store(&recordError, errno);
+                                break;
+                        }
+                        length = 0;
+                        if (!atomic_load(&recording)){
+                                break;
+                        }
+                        waitFor(0, RECORD_IDLE_MS * 1000000L);
+                        continue;
+                }
+
+                RecordedFrame *frame = &recordQueue[tail % RECORD_QUEUE_SIZE];
+                if (length + frame->length * 6 + 64 > RECORD_BATCH_SIZE){
+                        if (!writeAll(recordFile, recordBatch, length)){
+                                atomic_store(&recordError, errno);
+                                break;
+                        }
+                        length = 0;
+                }
+                length += sprintf(recordBatch + length, "[%.6f, \"o\", \"", frame->time);
+                length += escapeJson(recordBatch + length, frame->data, frame->length);
+                length += sprintf(recordBatch + length, "\"]\n");
+                atomic_store_explicit(&recordTail, tail + 1, memory_order_release);
+        }
+        return NULL;
+}
+
+void stopRecording(void){
+        // the writer finishes whatever is queued before the file (and gzip) are closed
+        if (recordFile < 0){
+                return;
+        }
+        while (lastFrameDropped && !atomic_load(&recordError)){
+                waitFor(0, RECORD_IDLE_MS * 1000000L);
+                droppedFrames--; // only counted as dropped if there is still no room
+                recordFrame();
+        }
+        atomic_store(&recording, 0);
+        pthread_join(recordThread, NULL);
+        close(recordFile);
+        recordFile = -1;
+        if (recordCompressor > 0){
+                waitpid(recordCompressor, NULL, 0);
+        }
+}
+
+void checkGuest(void){
+        // the guest is sighted on the tick its front edge scrolls onto the screen
+        if (sceneX+SCREEN_C-guest.x == 0){
+                emitEvent(GUEST_SIGHTED, -1, guest.type);
         }
 }
 
@@ -877,8 +2521,8 @@ void saveGame(void){
         }
 
         // updates player bests and encyclopedia lvl
-        fprintf(records, "%d\n", p1Highest);
-        fprintf(records, "%d\n", p2Highest);
+        fprintf(records, "%d\n", highest[0]);
+        fprintf(records, "%d\n", highest[1]);
         fprintf(records, "%d", encyclopediaLVL);
 
         // closes files
@@ -888,32 +2532,149 @@ void saveGame(void){
 }
 
 
+void rewindGame(void){
+        // the scene is redrawn for the restored tick without moving anything
+        if (rewindTicks(REWIND_STEP)){
+                drawRewoundScene();
+                drawScene(1); // one press of Z is one frame, so it is never skipped
+        }
+}
+
+_Bool offerRewind(void){
+        // the prompt is drawn over the last frame, which is presented even if the skip level would drop it
+        const char *prompt = "EATEN! PRESS Z TO REWIND OR ANY OTHER KEY TO FINISH";
+        memcpy(&scene[20][(SCREEN_C - strlen(prompt)) / 2], prompt, strlen(prompt));
+        memset(&sceneColors[20][(SCREEN_C - strlen(prompt)) / 2], PLAIN, strlen(prompt));
+        drawScene(1);
+
+        char input = getc(stdin);
+        if (input != 'z' && input != 'Z'){
+                return 0;
+        }
+        rewindGame();
+        return 1;
+}
+
 void endGame(void){
-        // shows ending result and saves game if players have died or either/both have won
-        if (!p1IsAlive && !p2IsAlive){
-                running = 0;
-                showResult(0);
-                saveGame();
-        }else if (p1TrashEvaded == MAX_SCORE || p2TrashEvaded == MAX_SCORE){
-                mvprintw(24,10, "X");
-                mvprintw(49,148, "");
-                refresh();
+        // the game is over once every fish is eaten or any reaches the score limit (eaten practice players may rewind instead)
+        int alive = 0, winners = 0, winner = 0;
+        for (int i = 0; i < numOfPlayers; i++){
+                alive += isAlive[i];
+                if (trashEvaded[i] >= scoreLimit){
+                        winners++;
+                        winner = i + 1;
+                }
+        }
+
+        if (alive == 0 && practice && offerRewind()){
+                return;
+        }
+        if (alive == 0 || winners > 0){
+                waitForPresenter();
                 running = 0;
-                waitFor(3,0);
-                if (p1TrashEvaded == MAX_SCORE && p2TrashEvaded == MAX_SCORE){
-                        showResult(3);
-                }else if (p2TrashEvaded == MAX_SCORE){
-                        showResult(2);
-                }else{
-                        showResult(1);
+                emitEvent(GAME_OVER, -1, alive == 0 ? 0 : winners > 1 ? -1 : winner);
+                dispatchEvents();
+        }
+}
+
+void emitEvent(EventType type, int player, int value){
+        // a tick that somehow overflows the buffer loses the extra events rather than stalling
+        if (numOfEvents == EVENT_LIMIT){
+                droppedEvents++;
+                return;
+        }
+        events[numOfEvents].type = type;
+        events[numOfEvents].player = player;
+        events[numOfEvents].value = value;
+        numOfEvents++;
+}
+
+void addListener(EventListener listener){
+        // listeners see each batch in the order they were added
+        if (numOfListeners < LISTENER_LIMIT){
+                listeners[numOfListeners++] = listener;
+        }
+}
+
+void dispatchEvents(void){
+        /* The batch is copied out and the buffer emptied first, since a listener can start a
+           whole new game (playing again from the result screen) before it returns */
+        GameEvent batch[EVENT_LIMIT];
+        int count = numOfEvents;
+        memcpy(batch, events, count * sizeof(GameEvent));
+        numOfEvents = 0;
+        for (int i = 0; i < numOfListeners && count > 0; i++){
+                listeners[i](batch, count);
+        }
+}
+
+void scoreEvents(const GameEvent *batch, int count){
+        // evaded trash adds to scores (and to records, for people), and each sighting levels up the encyclopedia
+        int player;
+        for (int i = 0; i < count; i++){
+                player = batch[i].player;
+                if (batch[i].type == TRASH_EVADED){
+                        trashEvaded[player] += batch[i].value;
+                        if (trashEvaded[player] > highest[player] && !isAutopilot[player]){
+                                highest[player] = trashEvaded[player];
+                        }
+                }else if (batch[i].type == GUEST_SIGHTED && encyclopediaLVL < 3){
+                        encyclopediaLVL++;
+                        encyclopediaLeveledUp = 1;
+                }
+        }
+}
+
+void countEvents(const GameEvent *batch, int count){
+        // telemetry totals, printed when the game exits
+        for (int i = 0; i < count; i++){
+                eventTotals[batch[i].type]++;
+        }
+}
+
+void saveEvents(const GameEvent *batch, int count){
+        // a finished game goes into the session log (unless nobody was playing) and the records are saved
+        for (int i = 0; i < count; i++){
+                if (batch[i].type != GAME_OVER){
+                        continue;
                 }
+                if (!isAutopilot[0] && !practice){
+                        recordSession();
+                }
+                saveRecords();
                 saveGame();
         }
 }
 
+void showEvents(const GameEvent *batch, int count){
+        // a win is marked for a moment before the result screen comes up
+        for (int i = 0; i < count; i++){
+                if (batch[i].type != GAME_OVER){
+                        continue;
+                }
+                if (batch[i].value != 0){
+                        mvprintw(24,10, "X");
+                        mvprintw(49,148, "");
+                        refresh();
+                        waitFor(3,0);
+                }
+                showResult(batch[i].value);
+        }
+}
+
+void reportEvents(void){
+        // one line of totals (nothing if no game was played)
+        if (eventTotals[TRASH_EVADED] + eventTotals[DAZED] + eventTotals[GAME_OVER] == 0){
+                return;
+        }
+        printf("Events: %ld trash evaded, %ld collisions, %ld dazed, %ld eaten, %ld guests sighted, %ld games over\n",
+               eventTotals[TRASH_EVADED], eventTotals[COLLISION], eventTotals[DAZED], eventTotals[EATEN],
+               eventTotals[GUEST_SIGHTED], eventTotals[GAME_OVER]);
+}
+
 void showResult(int playerNo){
-        /* sets parameters for displaying the screen corresponding 
-           to the number of players that won */
+        /* sets parameters for displaying the screen corresponding to the player that
+           won (players past the second have no art, so their win is written out) */
         int xOffset, yOffset, rows, cols;
         char *art;
         if (playerNo == 0){
@@ -934,6 +2695,12 @@ void showResult(int playerNo){
                 rows = PWON_R;
                 cols = P2WON_C;
                 art = p2Won;
+        }else if (playerNo > 2){
+                xOffset = 68;
+                yOffset = 23;
+                rows = 0;
+                cols = 0;
+                art = NULL;
         }else{
                 xOffset = 45;
                 yOffset = 16;
@@ -950,13 +2717,28 @@ void showResult(int playerNo){
                 }
         }
         
+        if (art == NULL){
+                mvprintw(yOffset, xOffset, "PLAYER %d WON!", playerNo);
+        }
+
         // displays prompt if players discovered new species
         if (encyclopediaLeveledUp){
                 mvprintw(31, 57, "Check Your Encyclopedia For New Entries");
         }
+        // shows how much of the game made it into the recording
+        if (recordFile >= 0){
+                mvprintw(33, 58, "Recorded %ld frames (%ld dropped)", recordedFrames, droppedFrames);
+        }
+        // and how much of it a slow terminal missed
+        if (skippedFrames > 0){
+                mvprintw(34, 56, "Skipped %ld of %lu frames (skip level %d)", skippedFrames, frameNumber, atomic_load(&skipLevel));
+        }
         // provides instructions to play again or quit game
         mvprintw(28, 66, "Press R to Play Again");
         mvprintw(29, 68, "Press Q to Quit");
+        if (ansiBackend){
+                clearok(stdscr, TRUE); // curses does not know what the ansi frames left on the terminal
+        }
         refresh();
 
         // receives input to fulfill user request
@@ -971,38 +2753,497 @@ void showResult(int playerNo){
         }
 }
 
+void resetGame(void){
+        // resets all per-game settings (players, objects, scroll position, and guest)
+        for (int i = 0; i < MAX_PLAYERS; i++){
+                players[i].x = startX[i];
+                players[i].y = startY[i];
+                players[i].type = FISH;
+                trashEvaded[i] = 0;
+                isAlive[i] = i < numOfPlayers;
+                isDazed[i] = 0;
+                dazedCount[i] = 0;
+                fishEyes[i] = 'o';
+        }
+        hashFish();
+
+        encyclopediaLeveledUp = 0;
+        scenery.count = 0;
+        trash.count = 0;
+        trashLimit = garbagePatch ? GARBAGE_PATCH_LIMIT : TRASH_LIMIT;
+        scoreLimit = garbagePatch ? GARBAGE_PATCH_SCORE : MAX_SCORE;
+        sceneX = 0;
+        seabedEnd = 0;
+        chooseGuest();
+}
+
 void runGame(void){
         // resets game settings and sets home page
         loadInfo();
-        chooseGuest();
         setHomePage();
 
-        p1.x = 40;
-        p1.y = 16;
-        p1TrashEvaded = 0; 
-        p1IsAlive = 1;
-        p1IsDazed = 0; 
-        p1DazedCount = 0;
-        fish1[5] = 'o';
-
-        p2.x = 50;
-        p2.y = 25;
-        p2TrashEvaded = 0;
-        p2IsAlive = 1;
-        p2IsDazed = 0;
-        p2DazedCount = 0;
-        fish2[5] = 'o';
-
-        encyclopediaLeveledUp = 0;
-        numOfScenery = 0;
-        numOfTrash = 0;
-        sceneX = 0;
+        resetGame();
+        invalidateTerminal();
+        if (practice){
+                resetRewind();
+                storeSnapshot();
+        }
 
-        // runs all the required processes for the game until it ends
+        /* runs all the required processes for the game until it ends (the demo runs on
+           a timer instead of keystrokes, and any key press ends it) */
+        struct pollfd keyboard = {STDIN_FILENO, POLLIN, 0};
+        int actions[MAX_PLAYERS];
+        _Bool demo = 1;
+        char input;
+        long ticks = 0;
+        for (int i = 0; i < numOfPlayers; i++){
+                demo &= isAutopilot[i];
+        }
         while(running){
-                manageObjects();
-                drawScene();
+                countHeap(ticks++ > 0); // everything after the first frame is steady state
+                if (demo){
+                        input = ' ';
+                        if (poll(&keyboard, 1, DEMO_TICK_MS) > 0){
+                                getc(stdin);
+                                memset(isAlive, 0, sizeof(isAlive));
+                        }
+                }else{
+                        input = getc(stdin);
+                        noteKey();
+                }
+                if (practice && (input == 'z' || input == 'Z')){
+                        rewindGame();
+                        continue;
+                }
+                for (int i = 0; i < numOfPlayers; i++){
+                        actions[i] = isAutopilot[i] ? autopilotInput(i) : keyAction(i, input);
+                }
+                updateScene(actions);
+                drawScene(0);
+                if (ticks == 1){
+                        waitForPresenter(); // the first frame is fully on screen before the steady state starts
+                }
                 moveScene();
+                if (practice){
+                        storeSnapshot();
+                }
+                countHeap(0); // the end of a game saves records and shows results
                 endGame();
         }
 }
+
+_Bool isFinished(void){
+        // the game is over once every player is eaten or any reaches the score limit
+        int alive = 0, won = 0;
+        for (int i = 0; i < numOfPlayers; i++){
+                alive += isAlive[i];
+                won += trashEvaded[i] >= scoreLimit;
+        }
+        return alive == 0 || won > 0;
+}
+
+void copyEntities(EntityStore *dst, const EntityStore *src){
+        // only the first count entries of each array are meaningful
+        memcpy(dst->x, src->x, src->count * sizeof(int));
+        memcpy(dst->y, src->y, src->count * sizeof(int));
+        memcpy(dst->width, src->width, src->count * sizeof(int));
+        memcpy(dst->type, src->type, src->count * sizeof(Type));
+        dst->count = src->count;
+}
+
+void saveState(GameState *state){
+        // everything the simulation changes is copied (the trash and scenery only up to their counts)
+        state->numOfPlayers = numOfPlayers;
+        memcpy(state->players, players, sizeof(players));
+        state->guest = guest;
+        state->sceneX = sceneX;
+        state->seabedEnd = seabedEnd;
+        state->randomState = randomState;
+        memcpy(state->trashEvaded, trashEvaded, sizeof(trashEvaded));
+        memcpy(state->isAlive, isAlive, sizeof(isAlive));
+        memcpy(state->isDazed, isDazed, sizeof(isDazed));
+        memcpy(state->dazedCount, dazedCount, sizeof(dazedCount));
+        memcpy(state->fishEyes, fishEyes, sizeof(fishEyes));
+        memcpy(state->highest, highest, sizeof(highest));
+        state->encyclopediaLVL = encyclopediaLVL;
+        state->encyclopediaLeveledUp = encyclopediaLeveledUp;
+        state->garbagePatch = garbagePatch;
+        state->trashLimit = trashLimit;
+        state->scoreLimit = scoreLimit;
+        copyEntities(&state->trash, &trash);
+        copyEntities(&state->scenery, &scenery);
+        memcpy(state->seabed, seabed, sizeof(seabed));
+        memcpy(state->seabedColors, seabedColors, sizeof(seabedColors));
+}
+
+void restoreState(const GameState *state){
+        // mirror of saveState() (the row hash is rebuilt from the restored positions)
+        numOfPlayers = state->numOfPlayers;
+        memcpy(players, state->players, sizeof(players));
+        guest = state->guest;
+        sceneX = state->sceneX;
+        seabedEnd = state->seabedEnd;
+        randomState = state->randomState;
+        memcpy(trashEvaded, state->trashEvaded, sizeof(trashEvaded));
+        memcpy(isAlive, state->isAlive, sizeof(isAlive));
+        memcpy(isDazed, state->isDazed, sizeof(isDazed));
+        memcpy(dazedCount, state->dazedCount, sizeof(dazedCount));
+        memcpy(fishEyes, state->fishEyes, sizeof(fishEyes));
+        memcpy(highest, state->highest, sizeof(highest));
+        encyclopediaLVL = state->encyclopediaLVL;
+        encyclopediaLeveledUp = state->encyclopediaLeveledUp;
+        garbagePatch = state->garbagePatch;
+        trashLimit = state->trashLimit;
+        scoreLimit = state->scoreLimit;
+        copyEntities(&trash, &state->trash);
+        copyEntities(&scenery, &state->scenery);
+        memcpy(seabed, state->seabed, sizeof(seabed));
+        memcpy(seabedColors, state->seabedColors, sizeof(seabedColors));
+        hashFish();
+}
+
+int putVarint(uint8_t *output, unsigned int value){
+        // returns the number of bytes written
+        int length = 0;
+        while (value >= 0x80){
+                output[length++] = (value & 0x7f) | 0x80;
+                value >>= 7;
+        }
+        output[length++] = value;
+        return length;
+}
+
+int encodeRuns(uint8_t *output, const uint8_t *data, const uint8_t *base, int length){
+        /* Each run starts with a varint of its length shifted left once. The low bit is set for a
+           repeated byte (written once after it) and clear for literal bytes (written in full).
+           Repeats shorter than MIN_RUN are left inside the surrounding literal run. */
+        int written = 0, literal = 0, i = 0, run;
+        uint8_t value;
+        while (i < length){
+                value = base ? data[i] ^ base[i] : data[i];
+                for (run = 1; i + run < length && (base ? data[i + run] ^ base[i + run] : data[i + run]) == value; run++);
+                if (run < MIN_RUN){
+                        i += run;
+                        continue;
+                }
+                if (literal < i){
+                        written += putVarint(output + written, (i - literal) << 1);
+                        for (int j = literal; j < i; j++){
+                                output[written++] = base ? data[j] ^ base[j] : data[j];
+                        }
+                }
+                written += putVarint(output + written, (run << 1) | 1);
+                output[written++] = value;
+                i += run;
+                literal = i;
+        }
+        if (literal < length){
+                written += putVarint(output + written, (length - literal) << 1);
+                for (int j = literal; j < length; j++){
+                        output[written++] = base ? data[j] ^ base[j] : data[j];
+                }
+        }
+        return written;
+}
+
+void applyRuns(uint8_t *image, const uint8_t *runs, int length, _Bool delta){
+        // a delta's runs of zeros leave the image as it is, so only the changes cost anything
+        unsigned int header, count;
+        int position = 0, i = 0, shift;
+        while (i < length){
+                header = 0;
+                shift = 0;
+                do {
+                        header |= (runs[i] & 0x7f) << shift;
+                        shift += 7;
+                } while (runs[i++] & 0x80);
+                count = header >> 1;
+
+                if (header & 1){
+                        if (!delta){
+                                memset(image + position, runs[i], count);
+                        }else if (runs[i] != 0){
+                                for (unsigned int j = 0; j < count; j++){
+                                        image[position + j] ^= runs[i];
+                                }
+                        }
+                        i++;
+                }else{
+                        for (unsigned int j = 0; j < count; j++){
+                                image[position + j] = delta ? image[position + j] ^ runs[i + j] : runs[i + j];
+                        }
+                        i += count;
+                }
+                position += count;
+        }
+}
+
+void resetRewind(void){
+        // the budget comes out of the arena once, with the entries at its front and the byte ring after them
+        if (rewindBytes == NULL){
+                snapshots = arenaAlloc(rewindBudget);
+                if (snapshots == NULL){
+                        return;
+                }
+                snapshotLimit = rewindBudget / REWIND_ENTRY_SHARE / sizeof(Snapshot);
+                rewindBytes = (uint8_t*)(snapshots + snapshotLimit);
+                rewindRing = rewindBudget - snapshotLimit * sizeof(Snapshot);
+        }
+        rewindHead = 0;
+        firstSnapshot = 0;
+        snapshotCount = 0;
+        sinceKeyframe = 0;
+}
+
+void dropOldestSnapshot(void){
+        // the deltas built on the oldest tick go with it, up to the next keyframe
+        do {
+                firstSnapshot = (firstSnapshot + 1) % snapshotLimit;
+                snapshotCount--;
+        } while (snapshotCount > 0 && !snapshots[firstSnapshot].keyframe);
+}
+
+void transposeSeabed(GameState *state, _Bool toColumns){
+        // snapshots keep the seabed (and its colors) column by column, so the column rendered each tick is one run of changes
+        uint8_t copy[SCENERY_R * SEABED_C];
+        uint8_t *planes[] = {(uint8_t*)&state->seabed[0][0], &state->seabedColors[0][0]};
+        for (int p = 0; p < 2; p++){
+                memcpy(copy, planes[p], sizeof(copy));
+                for (int j = 0; j < SCENERY_R; j++){
+                        for (int i = 0; i < SEABED_C; i++){
+                                if (toColumns){
+                                        planes[p][i * SCENERY_R + j] = copy[j * SEABED_C + i];
+                                }else{
+                                        planes[p][j * SEABED_C + i] = copy[i * SCENERY_R + j];
+                                }
+                        }
+                }
+        }
+}
+
+void storeSnapshot(void){
+        /* The state is saved into a zeroed image (so unused object slots and padding always
+           match) and stored as a keyframe or as a delta against the tick before. Room is made
+           at the head of the byte ring by dropping the oldest ticks, wrapping to the start when
+           the end is too small, and a delta that outlived its keyframe becomes a keyframe. */
+        if (rewindBytes == NULL){
+                return;
+        }
+        memset(&rewindCurrent, 0, sizeof(GameState));
+        saveState(&rewindCurrent);
+        transposeSeabed(&rewindCurrent, 1);
+
+        _Bool keyframe = snapshotCount == 0 || sinceKeyframe >= KEYFRAME_INTERVAL - 1;
+        int length = encodeRuns(rewindEncoded, (uint8_t*)&rewindCurrent, keyframe ? NULL : (uint8_t*)&rewindLatest, sizeof(GameState));
+        if ((size_t)length > rewindRing / 2){
+                snapshotCount = 0; // too big to share the ring, so the history would have a hole in it
+                return;
+        }
+
+        Snapshot *oldest;
+        if (rewindHead + length > rewindRing){
+                while (snapshotCount > 0 && (size_t)snapshots[firstSnapshot].offset >= rewindHead){
+                        dropOldestSnapshot(); // the unused end of the ring is skipped
+                }
+                rewindHead = 0;
+        }
+        while (snapshotCount > 0){
+                oldest = &snapshots[firstSnapshot];
+                if (snapshotCount < snapshotLimit && (oldest->offset >= (int)rewindHead + length || oldest->offset + oldest->length <= (int)rewindHead)){
+                        break;
+                }
+                dropOldestSnapshot();
+        }
+        if (snapshotCount == 0 && !keyframe){
+                keyframe = 1;
+                length = encodeRuns(rewindEncoded, (uint8_t*)&rewindCurrent, NULL, sizeof(GameState));
+                rewindHead = 0;
+                if ((size_t)length > rewindRing / 2){
+                        return;
+                }
+        }
+
+        Snapshot *snapshot = &snapshots[(firstSnapshot + snapshotCount) % snapshotLimit];
+        snapshot->offset = rewindHead;
+        snapshot->length = length;
+        snapshot->keyframe = keyframe;
+        memcpy(rewindBytes + rewindHead, rewindEncoded, length);
+        rewindHead += length;
+        snapshotCount++;
+        sinceKeyframe = keyframe ? 0 : sinceKeyframe + 1;
+        memcpy(&rewindLatest, &rewindCurrent, sizeof(GameState));
+}
+
+_Bool rewindTicks(int ticks){
+        /* The tick is rebuilt from the nearest keyframe before it by applying the deltas in
+           order, restored into the globals, and becomes the newest tick in the history */
+        if (snapshotCount == 0){
+                return 0;
+        }
+        int target = snapshotCount - 1 - ticks;
+        target = target < 0 ? 0 : target;
+        int keyframe = target;
+        while (!snapshots[(firstSnapshot + keyframe) % snapshotLimit].keyframe){
+                keyframe--;
+        }
+
+        Snapshot *snapshot = &snapshots[(firstSnapshot + target) % snapshotLimit];
+        rewindHead = snapshot->offset + snapshot->length;
+        for (int i = keyframe; i <= target; i++){
+                snapshot = &snapshots[(firstSnapshot + i) % snapshotLimit];
+                applyRuns((uint8_t*)&rewindLatest, rewindBytes + snapshot->offset, snapshot->length, !snapshot->keyframe);
+        }
+        memcpy(&rewindCurrent, &rewindLatest, sizeof(GameState));
+        transposeSeabed(&rewindCurrent, 0);
+        restoreState(&rewindCurrent);
+
+        snapshotCount = target + 1;
+        sinceKeyframe = target - keyframe;
+        return 1;
+}
+
+void drawRewoundScene(void){
+        // the drawing half of updateScene()
+        wipeScreen();
+        drawTrash();
+        drawFish();
+        drawShark();
+        drawScenery();
+        drawGuest();
+}
+
+Observation* envCreate(int count, const char *shmName){
+        /* The observations for all environments are placed in one shared mapping. If a name is
+           given it is created with shm_open so a trainer in another process can map it too,
+           otherwise it is anonymous (still shared with any forked workers). */
+        observationsSize = count * sizeof(Observation);
+        observations = MAP_FAILED;
+        if (shmName != NULL){
+                int fd = shm_open(shmName, O_CREAT | O_RDWR, 0600);
+                if (fd < 0){
+                        return NULL;
+                }
+                if (ftruncate(fd, observationsSize) == 0){
+                        observations = mmap(NULL, observationsSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                }
+                close(fd);
+        }else{
+                observations = mmap(NULL, observationsSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        }
+        if (observations == MAP_FAILED){
+                observations = NULL;
+                return NULL;
+        }
+        envStates = malloc(count * sizeof(GameState));
+        if (envStates == NULL){
+                envClose();
+                return NULL;
+        }
+        numOfEnvs = count;
+
+        if (fish == NULL){
+                /* the art is read without the loading screens or the curses error screen, and
+                   anything missing fails the call (leaving the next one to start over) */
+                if (!createArena(ART_BYTES)){
+                        envClose();
+                        return NULL;
+                }
+                loadGameAssets(NULL);
+                if (failedAsset != NULL){
+                        freeArena();
+                        fish = NULL;
+                        failedAsset = NULL;
+                        envClose();
+                        return NULL;
+                }
+        }
+        if (numOfListeners == 0){
+                addListener(scoreEvents); // training only needs the rules
+        }
+        for (int i = 0; i < count; i++){
+                envReset(i, i);
+        }
+        return observations;
+}
+
+void envReset(int env, unsigned int seed){
+        /* A fresh game with blank records is started from the seed, one tick is run
+           so the observation holds a real scene, and the state is parked again */
+        Observation *observation = &observations[env];
+        scene = observation->scene;
+        int actions[MAX_PLAYERS] = {0};
+        randomState = seed;
+        numOfPlayers = 2;
+        memset(highest, 0, sizeof(highest));
+        memset(isAutopilot, 0, sizeof(isAutopilot));
+        encyclopediaLVL = 0;
+        garbagePatch = 0;
+        resetGame();
+        updateScene(actions);
+        moveScene();
+
+        observation->p1TrashEvaded = 0;
+        observation->p2TrashEvaded = 0;
+        observation->p1Highest = highest[0];
+        observation->p2Highest = highest[1];
+        observation->encyclopediaLVL = encyclopediaLVL;
+        observation->p1Reward = 0;
+        observation->p2Reward = 0;
+        observation->p1IsAlive = 1;
+        observation->p2IsAlive = 1;
+        observation->done = 0;
+        saveState(&envStates[env]);
+        scene = sceneBuffer;
+}
+
+void envStep(const int *p1Actions, const int *p2Actions){
+        /* Every environment that is not done is swapped into the globals, advanced one tick
+           with its players' actions (0 none, 1 up, 2 down, 3 left, 4 right, anything else counts
+           as none), and swapped back out. Rewards are the trash evaded this tick, minus the score limit for getting eaten. */
+        Observation *observation;
+        int actions[MAX_PLAYERS] = {0};
+        int p1Before, p2Before;
+        _Bool p1WasAlive, p2WasAlive;
+
+        for (int i = 0; i < numOfEnvs; i++){
+                observation = &observations[i];
+                if (observation->done){
+                        continue;
+                }
+                scene = observation->scene;
+                restoreState(&envStates[i]);
+                p1Before = trashEvaded[0];
+                p2Before = trashEvaded[1];
+                p1WasAlive = isAlive[0];
+                p2WasAlive = isAlive[1];
+
+                actions[0] = p1Actions[i] >= 0 && p1Actions[i] <= 4 ? p1Actions[i] : 0;
+                actions[1] = p2Actions[i] >= 0 && p2Actions[i] <= 4 ? p2Actions[i] : 0;
+                updateScene(actions);
+                moveScene();
+
+                observation->p1TrashEvaded = trashEvaded[0];
+                observation->p2TrashEvaded = trashEvaded[1];
+                observation->p1Highest = highest[0];
+                observation->p2Highest = highest[1];
+                observation->encyclopediaLVL = encyclopediaLVL;
+                observation->p1Reward = trashEvaded[0] - p1Before - (p1WasAlive && !isAlive[0] ? scoreLimit : 0);
+                observation->p2Reward = trashEvaded[1] - p2Before - (p2WasAlive && !isAlive[1] ? scoreLimit : 0);
+                observation->p1IsAlive = isAlive[0];
+                observation->p2IsAlive = isAlive[1];
+                observation->done = isFinished();
+                saveState(&envStates[i]);
+        }
+        scene = sceneBuffer;
+}
+
+void envClose(void){
+        // unmaps the observations and frees the saved game states (safe after a failed envCreate())
+        if (observations != NULL){
+                munmap(observations, observationsSize);
+        }
+        free(envStates);
+        observations = NULL;
+        envStates = NULL;
+        numOfEnvs = 0;
+}
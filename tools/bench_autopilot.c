@@ -0,0 +1,65 @@
+/* Plays single player games with the autopilot at each lookahead depth and reports how many
+   decisions it makes per second, how long the fish survives, and how often it is still alive
+   when the game is cut off, along with the slowest decision and the share of decisions that ran
+   more than a millisecond past the per-tick budget (the search itself stops on time, so late
+   decisions come from the machine being busy).
+   Build and run from the repository root (the art is loaded from assets/):
+   cc -O2 -o bench_autopilot tools/bench_autopilot.c -lncurses -pthread && ./bench_autopilot [budget us] [games] [garbage]
+   Exits with 1 if more than 1% of the decisions at any depth were late. */
+#define ENV_LIBRARY
+#include "../p.c"
+
+// depths compared, and how long a game may last (score limits are lifted so only the shark ends a game)
+const int depths[] = {1, 2, 4, 6, 8, 12, 16};
+#define DEPTHS (int)(sizeof(depths) / sizeof(depths[0]))
+#define GAME_TICKS 1000
+
+int main(int argc, char **argv){
+        autopilotBudget = (argc > 1 ? atol(argv[1]) : AUTOPILOT_BUDGET_NS / 1000) * 1000;
+        int games = argc > 2 ? atoi(argv[2]) : 10;
+        _Bool garbage = argc > 3;
+        int actions[MAX_PLAYERS] = {0};
+        _Bool tooLate = 0;
+        struct timespec start;
+
+        if (!createArena(ART_BYTES)){
+                fprintf(stderr, "Could not map memory for the benchmark\n");
+                return 1;
+        }
+        loadAssets();
+        addListener(scoreEvents);
+        numOfPlayers = 1;
+        isAutopilot[0] = 1;
+        printf("budget %ld us per decision, %d games of up to %d ticks per depth%s\n",
+               autopilotBudget / 1000, games, GAME_TICKS, garbage ? ", garbage patch" : "");
+        printf("%6s %12s %8s %8s %12s %9s %8s\n", "depth", "decisions/s", "max us", "late", "ticks alive", "survived", "reached");
+        for (int d = 0; d < DEPTHS; d++){
+                autopilotMaxDepth = depths[d];
+                long decisions = 0, decidingUs = 0, maxUs = 0, late = 0, ticksAlive = 0, depthTotal = 0, us;
+                int survived = 0, tick;
+                for (int g = 0; g < games; g++){
+                        randomState = 1000 + g;
+                        garbagePatch = garbage;
+                        resetGame();
+                        scoreLimit = 1 << 30;
+                        for (tick = 0; tick < GAME_TICKS && isAlive[0]; tick++){
+                                clock_gettime(CLOCK_MONOTONIC, &start);
+                                actions[0] = autopilotInput(0);
+                                us = elapsedUs(start);
+                                decisions++;
+                                decidingUs += us;
+                                depthTotal += autopilotDepthReached;
+                                maxUs = us > maxUs ? us : maxUs;
+                                late += us > autopilotBudget / 1000 + 1000;
+                                updateScene(actions);
+                                moveScene();
+                        }
+                        ticksAlive += tick;
+                        survived += isAlive[0];
+                }
+                printf("%6d %12.0f %8ld %7.2f%% %12.0f %8d%% %8.1f\n", depths[d], decisions * 1e6 / (decidingUs > 0 ? decidingUs : 1),
+                       maxUs, late * 100.0 / decisions, (double)ticksAlive / games, survived * 100 / games, (double)depthTotal / decisions);
+                tooLate |= late * 100 > decisions;
+        }
+        return tooLate;
+}
@@ -0,0 +1,86 @@
+/* Replays the same seeded game through the curses and ansi backends (in color and in mono)
+   and reports the bytes each one sends to the terminal and the CPU time it spends per frame.
+   Terminal output goes to a scratch file, with curses set up for a 150x50 xterm.
+   Build and run from the repository root (the art is loaded from assets/):
+   cc -O2 -o bench_backends tools/bench_backends.c -lncurses -pthread && ./bench_backends [frames] */
+#define ENV_LIBRARY
+#include "../p.c"
+
+long cpuNs(void){
+        // CPU time used by the process so far
+        struct timespec now;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+        return now.tv_sec * 1000000000L + now.tv_nsec;
+}
+
+void replay(const char *name, _Bool ansi, _Bool color, int frames, int output){
+        // the game is replayed from the same seed, with the presenter's work done inline
+        int actions[MAX_PLAYERS] = {0};
+        unsigned int actionSeed = 7;
+        long bytes = 0, spent = 0, start;
+        off_t before;
+
+        colored = color;
+        randomState = 42;
+        resetGame();
+        invalidateTerminal();
+        clear();
+        refresh();
+        for (int f = 0; f < frames; f++){
+                for (int i = 0; i < numOfPlayers; i++){
+                        actions[i] = rand_r(&actionSeed) % 5;
+                }
+                updateScene(actions);
+                drawScene(1); // copies every frame for the presenter, which is not running
+                atomic_store(&framePending, 0);
+                before = lseek(output, 0, SEEK_CUR);
+                start = cpuNs();
+                if (ansi){
+                        presentAnsi();
+                }else{
+                        presentCurses();
+                }
+                spent += cpuNs() - start;
+                bytes += lseek(output, 0, SEEK_CUR) - before;
+                moveScene();
+                if (isFinished()){
+                        resetGame();
+                }
+        }
+        fprintf(stderr, "%-8s %-6s %12.0f %12.1f\n", name, color ? "color" : "mono", (double)bytes / frames, spent / 1000.0 / frames);
+}
+
+int main(int argc, char **argv){
+        int frames = argc > 1 ? atoi(argv[1]) : 2000;
+        char scratch[] = "/tmp/bench_backendsXXXXXX";
+        int output = mkstemp(scratch);
+        FILE *terminal = output < 0 ? NULL : fdopen(output, "w");
+        FILE *input = fopen("/dev/null", "r");
+        if (terminal == NULL || input == NULL || !createArena(ART_BYTES)){
+                fprintf(stderr, "Could not set up the benchmark\n");
+                return 1;
+        }
+        unlink(scratch);
+        loadAssets();
+        addListener(scoreEvents);
+
+        setenv("LINES", "50", 1);
+        setenv("COLUMNS", "150", 1);
+        if (newterm("xterm", terminal, input) == NULL){
+                fprintf(stderr, "Could not set up curses for xterm\n");
+                return 1;
+        }
+        startColors();
+        _Bool hasColors = colored;
+        dup2(output, STDOUT_FILENO); // the ansi backend writes to standard output (results go to standard error)
+
+        fprintf(stderr, "%-8s %-6s %12s %12s\n", "backend", "colors", "bytes/frame", "cpu us/frame");
+        replay("curses", 0, 0, frames, output);
+        replay("ansi", 1, 0, frames, output);
+        if (hasColors){
+                replay("curses", 0, 1, frames, output);
+                replay("ansi", 1, 1, frames, output);
+        }
+        endwin();
+        return 0;
+}
@@ -0,0 +1,65 @@
+/* Times the simulation (culling, generation, scoring, and drawing the scene) with the trash
+   store held at increasing sizes, up to a full garbage patch, against a fixed frame budget.
+   Build and run from the repository root (the art is loaded from assets/):
+   cc -O2 -o bench_entities tools/bench_entities.c -lncurses -pthread && ./bench_entities [budget us] [ticks]
+   Exits with 1 if the 99th percentile tick at the largest size is over the budget. */
+#define ENV_LIBRARY
+#include "../p.c"
+
+// trash limits timed (the last is a full garbage patch)
+const int sizes[] = {TRASH_LIMIT, 64, 256, 512, GARBAGE_PATCH_LIMIT};
+#define SIZES (int)(sizeof(sizes) / sizeof(sizes[0]))
+
+int compareLongs(const void *a, const void *b){
+        // ascending order for qsort()
+        long x = *(const long*)a, y = *(const long*)b;
+        return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv){
+        long budgetUs = argc > 1 ? atol(argv[1]) : 1000;
+        int ticks = argc > 2 ? atoi(argv[2]) : 5000;
+        long *times = malloc(ticks * sizeof(long));
+        int actions[MAX_PLAYERS] = {0};
+        long p99 = 0;
+        struct timespec start;
+
+        if (times == NULL || !createArena(ART_BYTES)){
+                fprintf(stderr, "Could not allocate the benchmark\n");
+                return 1;
+        }
+        loadAssets();
+        addListener(scoreEvents);
+        printf("budget %ld us per tick, %d ticks per size\n", budgetUs, ticks);
+        printf("%8s %10s %10s %10s %10s %8s\n", "limit", "live avg", "mean us", "p99 us", "max us", "over");
+        for (int s = 0; s < SIZES; s++){
+                randomState = 1;
+                garbagePatch = 1; // packs trash closely, so the store fills to its limit
+                resetGame();
+                trashLimit = sizes[s];
+                long total = 0, live = 0;
+                int over = 0;
+                for (int t = 0; t < ticks; t++){
+                        if (isFinished()){
+                                resetGame(); // the store refills to the limit on the next tick
+                                trashLimit = sizes[s];
+                        }
+                        for (int i = 0; i < numOfPlayers; i++){
+                                actions[i] = rand_r(&randomState) % 5;
+                        }
+                        clock_gettime(CLOCK_MONOTONIC, &start);
+                        updateScene(actions);
+                        moveScene();
+                        times[t] = elapsedUs(start);
+                        total += times[t];
+                        live += trash.count;
+                        over += times[t] > budgetUs;
+                }
+                qsort(times, ticks, sizeof(long), compareLongs);
+                p99 = times[ticks * 99 / 100];
+                printf("%8d %10ld %10.1f %10ld %10ld %8d\n", sizes[s], live / ticks, (double)total / ticks,
+                       p99, times[ticks - 1], over);
+        }
+        free(times);
+        return p99 > budgetUs;
+}
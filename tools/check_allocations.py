@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""Fails when a game touches the heap after its first frame.
+
+The game is built with -DCOUNT_ALLOCATIONS, which counts every malloc, calloc, realloc,
+and free made while a game is running and prints the total when it exits. The build is
+played under a pty (see latency.py) until a fish is eaten, and then quit from the result
+screen. The game runs in a scratch copy of the assets, so records and the session log are
+untouched.
+
+Run from the repository root:
+    python3 tools/check_allocations.py [--cc cc] [--presses 400] [-- --ansi --record x.cast]
+It exits with 1 when any heap call was counted, or when the game did not finish cleanly.
+"""
+import argparse
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+from latency import KEYS, Game, start
+
+HEAP_CALLS = re.compile(r'Heap calls during gameplay: (\d+)')
+
+
+def play(game, presses):
+    # presses go to both players until the result screen shows up, which is then left with Q
+    for press in range(presses):
+        if not game.alive or any('Press Q' in line for line in game.terminal.text()):
+            break
+        game.send(KEYS[press % 2][(press // 2) % 4].encode())
+        game.settle(0.01)
+    deadline = time.monotonic() + 10
+    while game.alive and time.monotonic() < deadline:
+        game.send(b'q')
+        game.settle(0.2)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('--cc', default='cc', help='C compiler (default cc)')
+    parser.add_argument('--presses', type=int, default=400, help='most presses before quitting (default 400)')
+    parser.add_argument('arguments', nargs='*', help='passed on to the game, e.g. -- --ansi')
+    options = parser.parse_args()
+
+    directory = tempfile.mkdtemp(prefix='allocations')
+    try:
+        binary = os.path.join(directory, 'p')
+        build = [options.cc, '-O2', '-DCOUNT_ALLOCATIONS', '-o', binary, 'p.c', '-lncurses', '-pthread']
+        if subprocess.run(build).returncode != 0:
+            print('Could not build the counting game')
+            return 1
+        shutil.copytree('assets', os.path.join(directory, 'assets'))
+        shutil.copy('encyclopedia.txt', directory)
+
+        game = Game(binary, options.arguments, directory)
+        if start(game) is None:
+            game.stop()
+            print('The game never showed both fish')
+            return 1
+        play(game, options.presses)
+        stuck = game.alive
+        game.stop()
+        status = os.waitstatus_to_exitcode(game.status)
+    finally:
+        shutil.rmtree(directory)
+
+    counted = [int(m.group(1)) for line in game.terminal.text() for m in HEAP_CALLS.finditer(line)]
+    if stuck or not counted:
+        print('The game did not finish, so no heap calls were reported')
+        return 1
+    print('Heap calls during gameplay: %d (exit status %d)' % (counted[-1], status))
+    return 1 if counted[-1] > 0 or status != 0 else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
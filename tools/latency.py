@@ -0,0 +1,355 @@
+#!/usr/bin/env python3
+"""Key to screen latency of the real game, measured end to end over a pseudo-terminal.
+
+The game is started in a 150x50 xterm pty (no display needed), Enter starts a two player
+game, and WASD / IJKL presses are sent one at a time. The output stream is run through a
+small terminal emulator, and a press counts as shown once that player's fish is drawn
+somewhere else. A game that ends early is started again until every press is timed, and
+a burst of presses at a fixed rate in a fresh game measures the sustained frame rate.
+The game runs in a scratch copy of the assets, so records and the session log are untouched.
+
+Run from the repository root after building p:
+    python3 tools/latency.py [--bin ./p] [--presses 200] [--max-ms 50] [-- --ansi]
+It exits with 1 when the 99th percentile is over --max-ms (or the game could not be measured).
+"""
+import argparse
+import fcntl
+import os
+import pty
+import re
+import select
+import shutil
+import signal
+import struct
+import sys
+import tempfile
+import termios
+import time
+
+ROWS, COLUMNS = 50, 150
+FISH = re.compile(r'\)\)[o@X]>')  # the back of the fish and its eye (the front can be off screen)
+KEYS = ('wsad', 'ikjl')  # up, down, left, right for players one and two
+
+
+class Terminal:
+    """Enough of an xterm to follow what curses and the ansi backend draw: cursor
+    movement, erasing, scrolling, and printing (colors and modes are ignored)."""
+
+    sequence = re.compile(rb'\x1b\[([?>=]?)([0-9;]*)[ -/]*([@-~])|\x1b\][^\x07\x1b]*(?:\x07|\x1b\\)'
+                          rb'|\x1b[()*+].|\x1b[ -/]*[0-Z\\^-~]')
+
+    def __init__(self, rows, columns):
+        self.rows, self.columns = rows, columns
+        self.cells = [[' '] * columns for _ in range(rows)]
+        self.y = self.x = 0
+        self.top, self.bottom = 0, rows - 1
+        self.saved = (0, 0)
+        self.last = ' '
+        self.pending = b''
+
+    def text(self):
+        return [''.join(row) for row in self.cells]
+
+    def scroll(self, count, up=True):
+        for _ in range(count):
+            if up:
+                del self.cells[self.top]
+                self.cells.insert(self.bottom, [' '] * self.columns)
+            else:
+                del self.cells[self.bottom]
+                self.cells.insert(self.top, [' '] * self.columns)
+
+    def newline(self):
+        if self.y == self.bottom:
+            self.scroll(1)
+        elif self.y < self.rows - 1:
+            self.y += 1
+
+    def put(self, c):
+        # the cursor stays past the last column until the next character wraps it
+        if self.x >= self.columns:
+            self.x = 0
+            self.newline()
+        self.cells[self.y][self.x] = c
+        self.last = c
+        self.x += 1
+
+    def erase(self, y, start, end):
+        for x in range(max(start, 0), min(end, self.columns)):
+            self.cells[y][x] = ' '
+
+    def csi(self, private, params, final):
+        n = [int(p) if p else 0 for p in params.split(';')] if params else []
+        first = n[0] if n else 0
+        count = max(first, 1)
+        if private:
+            return
+        if final in 'Hf':
+            self.y = (n[0] or 1) - 1 if n else 0
+            self.x = (n[1] or 1) - 1 if len(n) > 1 else 0
+        elif final == 'A':
+            self.y -= count
+        elif final in 'Be':
+            self.y += count
+        elif final in 'Ca':
+            self.x += count
+        elif final == 'D':
+            self.x -= count
+        elif final in 'G`':
+            self.x = count - 1
+        elif final == 'd':
+            self.y = count - 1
+        elif final == 'K':
+            start, end = {0: (self.x, self.columns), 1: (0, self.x + 1), 2: (0, self.columns)}.get(first, (0, 0))
+            self.erase(self.y, start, end)
+        elif final == 'J':
+            rows = {0: range(self.y + 1, self.rows), 1: range(0, self.y)}.get(first, range(self.rows))
+            if first in (0, 1):
+                self.csi('', str(first), 'K')
+            for y in rows:
+                self.erase(y, 0, self.columns)
+        elif final == 'X':
+            self.erase(self.y, self.x, self.x + count)
+        elif final == '@':
+            line = self.cells[self.y]
+            self.cells[self.y] = (line[:self.x] + [' '] * count + line[self.x:])[:self.columns]
+        elif final == 'P':
+            line = self.cells[self.y]
+            self.cells[self.y] = line[:self.x] + line[self.x + count:] + [' '] * min(count, self.columns - self.x)
+        elif final in 'LM' and self.top <= self.y <= self.bottom:
+            top, self.top = self.top, self.y
+            self.scroll(count, up=final == 'M')
+            self.top = top
+        elif final in 'ST':
+            self.scroll(count, up=final == 'S')
+        elif final == 'r':
+            self.top = (n[0] or 1) - 1 if n else 0
+            self.bottom = (n[1] or self.rows) - 1 if len(n) > 1 else self.rows - 1
+            self.y = self.x = 0
+        elif final == 'b':
+            for _ in range(count):
+                self.put(self.last)
+        self.y = max(0, min(self.rows - 1, self.y))
+        self.x = max(0, min(self.columns - 1, self.x))
+
+    def escape(self, code):
+        if code == b'7':
+            self.saved = (self.y, self.x)
+        elif code == b'8':
+            self.y, self.x = self.saved
+        elif code == b'M':
+            if self.y == self.top:
+                self.scroll(1, up=False)
+            else:
+                self.y = max(0, self.y - 1)
+        elif code in (b'D', b'E'):
+            self.x = 0 if code == b'E' else self.x
+            self.newline()
+
+    def feed(self, data):
+        data = self.pending + data
+        self.pending = b''
+        i = 0
+        while i < len(data):
+            byte = data[i]
+            if byte == 0x1b:
+                match = self.sequence.match(data, i)
+                if match is None:
+                    if len(data) - i < 64:
+                        self.pending = data[i:]  # the rest of the sequence comes with the next read
+                        return
+                    i += 1
+                    continue
+                if match.group(3) is not None:
+                    self.csi(match.group(1).decode(), match.group(2).decode(), match.group(3).decode())
+                else:
+                    self.escape(match.group(0)[1:2])
+                i = match.end()
+                continue
+            if byte == 0x0d:
+                self.x = 0
+            elif byte == 0x0a:
+                self.newline()
+            elif byte == 0x08:
+                self.x = max(0, self.x - 1)
+            elif byte == 0x09:
+                self.x = min(self.columns - 1, (self.x // 8 + 1) * 8)
+            elif 0x20 <= byte < 0x7f:
+                self.put(chr(byte))
+            i += 1
+
+
+class Game:
+    """The game running in a pty, with everything it writes fed to the emulator."""
+
+    def __init__(self, binary, arguments, directory):
+        self.terminal = Terminal(ROWS, COLUMNS)
+        self.pid, self.fd = pty.fork()
+        if self.pid == 0:
+            os.chdir(directory)
+            os.environ.update(LINES=str(ROWS), COLUMNS=str(COLUMNS), TERM='xterm')
+            os.execv(binary, [binary, '--fast-start'] + arguments)
+        fcntl.ioctl(self.fd, termios.TIOCSWINSZ, struct.pack('HHHH', ROWS, COLUMNS, 0, 0))
+        self.alive = True
+
+    def read(self, seconds):
+        # feeds whatever arrives within the time, returning once something did
+        ready, _, _ = select.select([self.fd], [], [], max(seconds, 0))
+        if not ready:
+            return False
+        try:
+            data = os.read(self.fd, 1 << 16)
+        except OSError:
+            data = b''
+        if not data:
+            self.alive = False
+            return False
+        self.terminal.feed(data)
+        return True
+
+    def settle(self, seconds):
+        # reads until the output has been quiet for the given time
+        while self.alive and self.read(seconds):
+            pass
+
+    def send(self, key):
+        os.write(self.fd, key)
+
+    def fish(self):
+        # (row, eye column) of every fish on screen, below the three header rows
+        return [(y, m.start() + 2) for y, line in enumerate(self.terminal.text()[3:], 3)
+                for m in FISH.finditer(line)]
+
+    def stop(self):
+        if self.alive:
+            os.kill(self.pid, signal.SIGTERM)
+        _, self.status = os.waitpid(self.pid, 0)
+        os.close(self.fd)
+
+
+def follow(previous, found):
+    # pairs the fish on screen with the players' last positions (closest pairing wins)
+    if len(found) != 2:
+        return None
+    straight = sum(abs(a[0] - b[0]) + abs(a[1] - b[1]) for a, b in zip(previous, found))
+    crossed = sum(abs(a[0] - b[0]) + abs(a[1] - b[1]) for a, b in zip(previous, found[::-1]))
+    return list(found) if straight <= crossed else list(found[::-1])
+
+
+def percentile(samples, percent):
+    ordered = sorted(samples)
+    return ordered[min(len(ordered) - 1, len(ordered) * percent // 100)]
+
+
+def start(game):
+    # the intro may still be waiting for a key, so Enter is pressed until both fish are out
+    deadline = time.monotonic() + 15
+    while time.monotonic() < deadline and game.alive:
+        game.send(b'\r')
+        game.settle(0.3)
+        found = sorted(game.fish())
+        if len(found) == 2:
+            return found
+    return None
+
+
+def measure(game, positions, presses, timeout):
+    # one press at a time: the latency is the wait until the pressed player's fish moves
+    samples, unmoved = [], 0
+    for press in range(presses):
+        player = press % 2
+        key = KEYS[player][(press // 2) % 4].encode()
+        sent = time.monotonic()
+        game.send(key)
+        moved = None
+        while moved is None and game.alive and time.monotonic() - sent < timeout:
+            if game.read(sent + timeout - time.monotonic()):
+                now = follow(positions, game.fish())
+                if now is not None and now[player] != positions[player]:
+                    moved = time.monotonic() - sent
+                    positions = now
+        if moved is None:
+            unmoved += 1  # blocked by trash, or the game ended
+        else:
+            samples.append(moved * 1000)
+        game.settle(0.01)
+        now = follow(positions, game.fish())
+        if now is None:
+            break  # a fish was eaten, so the game is over
+        positions = now
+    return samples, unmoved, positions
+
+
+def burst(game, positions, rate, seconds):
+    # presses arrive at a fixed rate, and every change of fish positions on screen is a frame
+    # (the rate is over the time the game lasted, if a fish was eaten before the end)
+    frames, interval = 0, 1.0 / rate
+    began = time.monotonic()
+    press = 0
+    while game.alive and time.monotonic() - began < seconds:
+        due = began + press * interval
+        if time.monotonic() >= due:
+            game.send(KEYS[press % 2][(press // 2) % 4].encode())
+            press += 1
+            continue
+        if game.read(due - time.monotonic()):
+            now = follow(positions, game.fish())
+            if now is None:
+                break
+            if now != positions:
+                frames += 1
+                positions = now
+    return frames / (time.monotonic() - began)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split('\n')[0])
+    parser.add_argument('--bin', default='./p', help='game binary (default ./p)')
+    parser.add_argument('--presses', type=int, default=200, help='timed key presses (default 200)')
+    parser.add_argument('--timeout-ms', type=int, default=500, help='wait for a fish to move (default 500)')
+    parser.add_argument('--rate', type=int, default=60, help='presses per second in the burst (default 60)')
+    parser.add_argument('--burst', type=float, default=3, help='seconds of the burst (default 3)')
+    parser.add_argument('--max-ms', type=float, default=50, help='99th percentile limit (default 50)')
+    parser.add_argument('arguments', nargs='*', help='passed on to the game, e.g. -- --ansi')
+    options = parser.parse_args()
+
+    directory = tempfile.mkdtemp(prefix='latency')
+    shutil.copytree('assets', os.path.join(directory, 'assets'))
+    shutil.copy('encyclopedia.txt', directory)
+    binary = os.path.abspath(options.bin)
+    samples, unmoved, fps = [], 0, None
+    try:
+        while fps is None:
+            game = Game(binary, options.arguments, directory)
+            try:
+                positions = start(game)
+                if positions is None:
+                    print('The game never showed both fish')
+                    return 1
+                if len(samples) + unmoved < options.presses:
+                    more, blocked, positions = measure(game, positions, options.presses - len(samples) - unmoved,
+                                                       options.timeout_ms / 1000)
+                    samples += more
+                    unmoved += blocked
+                else:
+                    fps = burst(game, positions, options.rate, options.burst)
+            finally:
+                game.stop()
+    finally:
+        shutil.rmtree(directory)
+
+    if not samples:
+        print('No key press moved a fish')
+        return 1
+    p99 = percentile(samples, 99)
+    print('Key to screen latency over %d presses (%d did not move a fish): p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms'
+          % (len(samples), unmoved, percentile(samples, 50), percentile(samples, 90), p99, max(samples)))
+    print('Sustained %.1f frames per second with %d presses per second' % (fps, options.rate))
+    if p99 > options.max_ms:
+        print('Latency is over the %g ms limit' % options.max_ms)
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())